@@ -4,15 +4,26 @@
 
 struct AppContext {
     class Scene *scene;         // viewing data
-    class Input *input;         // user interface data
+    class Simulation *simulation;   // input and movement
     class Terrain *terrain;     // terrain geometry
     class Marker *lightmarker;  // light marker geometry
+    class Capture *capture;     // frame capture, if recording
+    class ShaderWatcher *watcher;   // shader file change detection
+    class UniformRing *uniforms;    // per-frame uniform block storage
+    class InputLog *inputLog;   // input recording or replay, if any
+    class FrameScheduler *scheduler;    // GL work run between frames
+    class GpuProfiler *gpuProfiler;     // GPU time per part of frame
+    class MetricsExporter *exporter;    // metrics publishing, if any
+    bool redraw;                // something other than the view changed
 
     // uniform (aka shader parameter) block indices
     enum { SCENE_UNIFORMS, MODEL_UNIFORMS };
 
     // initialize all pointers to NULL to allow delete in destructor
-    AppContext() : scene(0), input(0), terrain(0), lightmarker(0) {}
+    AppContext() : scene(0), simulation(0), terrain(0), lightmarker(0),
+                   capture(0), watcher(0), uniforms(0), inputLog(0),
+                   scheduler(0), gpuProfiler(0), exporter(0),
+                   redraw(true) {}
 
     // clean up any context data
     ~AppContext();
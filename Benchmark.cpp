@@ -0,0 +1,280 @@
+// render a scripted camera path offscreen and report frame times
+
+#include "Benchmark.hpp"
+#include "Scene.hpp"
+#include "Terrain.hpp"
+#include "Shader.hpp"
+#include "FramePacer.hpp"
+#include "MemoryTracker.hpp"
+#include "GLState.hpp"
+#include "Vec.inl"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <math.h>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // milliseconds between two times
+    double milliseconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // nearest-rank percentile p (0-100) of sorted values
+    double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        size_t rank = size_t(ceil(p / 100 * sorted.size()));
+        return sorted[rank > 0 ? rank-1 : 0];
+    }
+
+    // write "name": {mean, percentiles, max} for one set of times
+    void writeStats(FILE *out, const char *name, std::vector<double> times)
+    {
+        std::sort(times.begin(), times.end());
+        double sum = 0;
+        for(size_t i=0; i<times.size(); ++i)
+            sum += times[i];
+        fprintf(out, "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, "
+                "\"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+                name, times.empty() ? 0 : sum / times.size(),
+                percentile(times, 50), percentile(times, 95),
+                percentile(times, 99), times.empty() ? 0 : times.back());
+    }
+}
+
+//
+// load path and create offscreen framebuffer
+//
+Benchmark::Benchmark(const char *pathFile, unsigned int n, int w, int h)
+    : framebufferID(0), frame(0), runTime(0),
+      frames(n), width(w), height(h), trianglesPerFrame(0),
+      meshSeconds(0), meshCached(false), firstFrameSeconds(0)
+{
+    renderbufferIDs[COLOR_BUFFER] = renderbufferIDs[DEPTH_BUFFER] = 0;
+    queryIDs[0] = 0;
+    if (! loadPath(pathFile))
+        return;
+
+    // color and depth at a fixed size, independent of any window
+    glGenRenderbuffers(NUM_RENDERBUFFERS, renderbufferIDs);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbufferIDs[COLOR_BUFFER]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbufferIDs[DEPTH_BUFFER]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebufferID);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, renderbufferIDs[COLOR_BUFFER]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, renderbufferIDs[DEPTH_BUFFER]);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "benchmark: %dx%d framebuffer incomplete (0x%x)\n",
+                width, height, status);
+        glDeleteFramebuffers(1, &framebufferID);
+        framebufferID = 0;
+        return;
+    }
+
+    glGenQueries(NUM_QUERIES, queryIDs);
+    cpuTimes.reserve(frames);
+    gpuTimes.reserve(frames);
+}
+
+//
+// free GL objects
+//
+Benchmark::~Benchmark()
+{
+    if (framebufferID)
+        glDeleteFramebuffers(1, &framebufferID);
+    if (renderbufferIDs[COLOR_BUFFER])
+        glDeleteRenderbuffers(NUM_RENDERBUFFERS, renderbufferIDs);
+    if (queryIDs[0])
+        glDeleteQueries(NUM_QUERIES, queryIDs);
+}
+
+//
+// read camera path: one key per line, "x y heading pitch distance",
+// with blank lines and # comments ignored. Keys are evenly spaced over
+// the run.
+//
+bool Benchmark::loadPath(const char *pathFile)
+{
+    FILE *fp = fopen(pathFile, "r");
+    if (!fp) {
+        fprintf(stderr, "benchmark: can't read camera path %s\n", pathFile);
+        return false;
+    }
+
+    char line[256];
+    for(int lineNumber = 1; fgets(line, sizeof(line), fp); ++lineNumber) {
+        char *text = line;
+        while (*text == ' ' || *text == '\t') ++text;
+        if (*text == '#' || *text == '\n' || *text == '\r' || *text == 0)
+            continue;
+
+        Key key;
+        if (sscanf(text, "%f %f %f %f %f", &key.position.x, &key.position.y,
+                   &key.view.x, &key.view.y, &key.view.z) != 5) {
+            fprintf(stderr, "%s:%d: expected x y heading pitch distance\n",
+                    pathFile, lineNumber);
+            path.clear();
+            break;
+        }
+        path.push_back(key);
+    }
+    fclose(fp);
+
+    if (path.empty())
+        fprintf(stderr, "benchmark: no camera keys in %s\n", pathFile);
+    return ! path.empty();
+}
+
+//
+// wait for one frame's GPU time, keeping it if past warm-up
+//
+void Benchmark::collectQuery(unsigned int f)
+{
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queryIDs[f % NUM_QUERIES], GL_QUERY_RESULT, &ns);
+    if (f >= WARMUP_FRAMES)
+        gpuTimes.push_back(ns * 1e-6);
+}
+
+//
+// set up next frame
+//
+bool Benchmark::beginFrame(Scene &scene, Terrain &terrain)
+{
+    unsigned int total = WARMUP_FRAMES + frames;
+    if (frame == total) {
+        // collect queries still in flight, and stop the clock once the
+        // GPU is done too
+        for(unsigned int f = frame > NUM_QUERIES ? frame - NUM_QUERIES : 0;
+            f < frame; ++f)
+            collectQuery(f);
+        glFinish();
+        runTime = 1e-3 * milliseconds(runStart, Clock::now());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+
+    // this frame reuses the query from NUM_QUERIES frames ago
+    if (frame >= NUM_QUERIES)
+        collectQuery(frame - NUM_QUERIES);
+
+    // timed run starts with nothing left over from the warm-up
+    if (frame == WARMUP_FRAMES) {
+        glFinish();
+        runStart = Clock::now();
+    }
+
+    if (frame == 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+        scene.viewport(width, height);
+    }
+
+    // position along path: warm-up frames stay at the start
+    float t = 0;
+    if (frame >= WARMUP_FRAMES && frames > 1)
+        t = float(frame - WARMUP_FRAMES) / float(frames - 1);
+    Key key = path[0];
+    if (path.size() > 1) {
+        float u = t * float(path.size() - 1);
+        unsigned int k = std::min((unsigned int)u,
+                                  (unsigned int)path.size() - 2);
+        float f = u - float(k);
+        key.position = lerp(path[k].position, path[k+1].position, f);
+        key.view = lerp(path[k].view, path[k+1].view, f);
+    }
+
+    // stand on the terrain like Input does
+    scene.positionSph.x = key.position.x;
+    scene.positionSph.y = key.position.y;
+    terrain.getElevation(key.position.x, key.position.y, scene.positionSph.z,
+                         scene.alignmentSph.x, scene.alignmentSph.y);
+    scene.viewSph = key.view;
+    scene.view();
+
+    frameStart = Clock::now();
+    glBeginQuery(GL_TIME_ELAPSED, queryIDs[frame % NUM_QUERIES]);
+    return true;
+}
+
+//
+// end this frame's timing
+//
+void Benchmark::endFrame()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    glFlush();
+    if (frame >= WARMUP_FRAMES)
+        cpuTimes.push_back(milliseconds(frameStart, Clock::now()));
+    ++frame;
+}
+
+//
+// results as a JSON object
+//
+void Benchmark::report(FILE *out, const char *renderer,
+                       const FramePacer &pacer)
+{
+    // keep renderer string valid JSON: escape quotes, backslashes and
+    // control characters, leaving room for the longest escape
+    char name[256];
+    unsigned int n = 0;
+    for(; renderer && *renderer && n < sizeof(name)-7; ++renderer) {
+        unsigned char c = (unsigned char)*renderer;
+        if (c < 0x20)
+            n += snprintf(name+n, sizeof(name)-n, "\\u%04x", c);
+        else {
+            if (c == '"' || c == '\\') name[n++] = '\\';
+            name[n++] = c;
+        }
+    }
+    name[n] = 0;
+
+    double seconds = runTime > 0 ? runTime : 1;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"renderer\": \"%s\",\n", name);
+    fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n", width, height);
+    fprintf(out, "  \"frames\": %u,\n", (unsigned int)cpuTimes.size());
+    fprintf(out, "  \"seconds\": %.4f,\n", runTime);
+    fprintf(out, "  \"fps\": %.2f,\n", cpuTimes.size() / seconds);
+    writeStats(out, "cpu_ms", cpuTimes);
+    fprintf(out, ",\n");
+    writeStats(out, "gpu_ms", gpuTimes);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"cpu_utilization\": {\"active\": %.4f, \"idle\": %.4f},\n",
+            pacer.activeUtilization(), pacer.idleUtilization());
+    fprintf(out, "  \"triangles_per_frame\": %u,\n", trianglesPerFrame);
+    fprintf(out, "  \"triangles_per_second\": %.0f,\n",
+            double(trianglesPerFrame) * cpuTimes.size() / seconds);
+    fprintf(out, "  \"mesh_seconds\": %.6f,\n", meshSeconds);
+    fprintf(out, "  \"mesh_cached\": %s,\n", meshCached ? "true" : "false");
+    fprintf(out, "  \"first_frame_seconds\": %.4f,\n", firstFrameSeconds);
+    fprintf(out, "  \"shader_programs\": {\"cached\": %u, \"compiled\": %u},\n",
+            shaderCacheHits, shaderCacheMisses);
+    fprintf(out, "  \"gl_binds_per_frame\": {\"issued\": %.1f, "
+            "\"elided\": %.1f},\n",
+            GLState::issuedPerFrame(), GLState::elidedPerFrame());
+    fprintf(out, "  \"memory_bytes\": ");
+    MemoryTracker::writeJSON(out);
+    fprintf(out, "\n");
+    fprintf(out, "}\n");
+}
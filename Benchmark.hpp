@@ -0,0 +1,87 @@
+// render a scripted camera path offscreen and report frame times
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include "Vec.hpp"
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+class Scene;
+class Terrain;
+class FramePacer;
+
+// Draws a fixed number of frames into a framebuffer object of a fixed
+// size, moving the view along a camera path. CPU time is measured
+// around each frame's GL calls; GPU time with a ring of timer queries,
+// read back a few frames later so the GPU never waits for the CPU.
+// A few untimed warm-up frames come first.
+class Benchmark {
+// private data
+private:
+    // camera path key: Scene positionSph x and y, and viewSph
+    struct Key {
+        Vec2f position;         // ground position; height follows terrain
+        Vec3f view;             // heading, pitch (radians) and distance
+    };
+    std::vector<Key> path;
+
+    // offscreen framebuffer
+    unsigned int framebufferID;
+    enum {COLOR_BUFFER, DEPTH_BUFFER, NUM_RENDERBUFFERS};
+    unsigned int renderbufferIDs[NUM_RENDERBUFFERS];
+
+    // GPU timer queries, one per frame in flight
+    enum {NUM_QUERIES = 4};
+    unsigned int queryIDs[NUM_QUERIES];
+
+    // frame counts and timing
+    enum {WARMUP_FRAMES = 10};
+    unsigned int frame;         // current frame, including warm-up
+    std::chrono::steady_clock::time_point frameStart, runStart;
+    double runTime;             // seconds for all timed frames
+    std::vector<double> cpuTimes, gpuTimes;   // per timed frame (ms)
+
+// public data
+public:
+    unsigned int frames;        // timed frames to draw
+    int width, height;          // framebuffer size
+    unsigned int trianglesPerFrame; // set by caller for throughput
+    double meshSeconds;         // set by caller: mesh build or load time
+    bool meshCached;            // set by caller: mesh came from cache
+    double firstFrameSeconds;   // set by caller: program start until
+                                // the first frame was drawn
+
+// public methods
+public:
+    // load camera path file and create framebuffer
+    // current GL context must be usable
+    Benchmark(const char *pathFile, unsigned int frames,
+              int width, int height);
+
+    // release GL objects
+    ~Benchmark();
+
+    // were the path and framebuffer set up?
+    bool valid() const { return ! path.empty() && framebufferID != 0; }
+
+    // start next frame: bind framebuffer, move view along path, and
+    // start timing. Returns false once all frames are drawn.
+    bool beginFrame(Scene &scene, Terrain &terrain);
+
+    // finish timing this frame
+    void endFrame();
+
+    // write results as JSON, including CPU use from pacer
+    void report(FILE *out, const char *renderer, const FramePacer &pacer);
+
+// private methods
+private:
+    // read camera path, returning false on error
+    bool loadPath(const char *pathFile);
+
+    // get GPU time of the query for frame f
+    void collectQuery(unsigned int f);
+};
+
+#endif
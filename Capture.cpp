@@ -0,0 +1,229 @@
+// capture rendered frames to disk without stalling rendering
+
+#include "Capture.hpp"
+#include "ImagePPM.hpp"
+#include "MemoryTracker.hpp"
+#include "GLState.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+namespace {
+    // true if pattern has exactly one integer conversion like %d or
+    // %05d and no other %, so it is safe to pass to snprintf
+    bool isFramePattern(const char *pattern)
+    {
+        unsigned int conversions = 0;
+        for(const char *p = strchr(pattern, '%'); p; p = strchr(p, '%')) {
+            ++p;
+            while (*p == '0' || *p == '-') ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+            if (*p != 'd' && *p != 'u' && *p != 'i')
+                return false;
+            ++conversions;
+        }
+        return conversions == 1;
+    }
+}
+
+//
+// create pixel buffers and start writer thread
+//
+Capture::Capture(const char *name, bool raw)
+    : head(0), count(0), stopping(false),
+      output(name), rawVideo(raw), numbered(false),
+      video(0), videoWidth(0), videoHeight(0),
+      frameNumber(0), written(0), dropped(0)
+{
+    glGenBuffers(NUM_BUFFERS, bufferIDs);
+    for(int i=0; i<NUM_BUFFERS; ++i)
+        bufferSize[i] = 0;
+
+    if (rawVideo) {
+        video = fopen(output, "wb");
+        if (!video)
+            fprintf(stderr, "error creating %s\n", output);
+    }
+    else {
+        numbered = isFramePattern(output);
+        if (! numbered)
+            fprintf(stderr, "capture: %s has no frame number like %%05d, "
+                    "saving as %s#####.ppm\n", output, output);
+    }
+
+    writer = std::thread(&Capture::writeFrames, this);
+}
+
+//
+// flush remaining frames, stop writer, and report
+//
+Capture::~Capture()
+{
+    // everything still in flight is wanted, so wait for it this time
+    collect(true);
+
+    // a frame the GPU still hasn't finished after that is given up on
+    for(; count > 0; --count) {
+        glDeleteSync(pending[head].fence);
+        head = (head + 1) % NUM_BUFFERS;
+        ++dropped;
+    }
+    GLState::deleteBuffers(NUM_BUFFERS, bufferIDs);
+    MemoryTracker::deleteBuffers(NUM_BUFFERS, bufferIDs);
+
+    {
+        std::lock_guard<std::mutex> guard(queueLock);
+        stopping = true;
+    }
+    queueReady.notify_one();
+    writer.join();
+
+    fprintf(stderr, "capture: %u frames written, %u dropped\n",
+            (unsigned int)written, (unsigned int)dropped);
+    if (video) {
+        fclose(video);
+        fprintf(stderr, "capture: raw rgb24 %ux%u video in %s\n",
+                videoWidth, videoHeight, output);
+    }
+}
+
+//
+// start asynchronous readback of the current frame
+//
+void Capture::frame(int width, int height)
+{
+    // make room by retiring readbacks that have finished
+    collect(false);
+
+    ++frameNumber;
+    if (count == NUM_BUFFERS) {
+        // GPU hasn't caught up: skip rather than wait
+        ++dropped;
+        return;
+    }
+
+    // (re)size buffer for this frame
+    unsigned int slot = (head + count) % NUM_BUFFERS;
+    unsigned int size = 3 * width * height;
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, bufferIDs[slot]);
+    if (bufferSize[slot] != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+        bufferSize[slot] = size;
+        MemoryTracker::bufferData(MemoryTracker::CAPTURE, bufferIDs[slot],
+                                  size);
+    }
+
+    // copy into buffer object: returns without waiting for the GPU
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+
+    pending[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending[slot].width = width;
+    pending[slot].height = height;
+    pending[slot].frame = frameNumber;
+    ++count;
+}
+
+//
+// map finished readbacks, oldest first, and queue them for writing
+//
+void Capture::collect(bool wait)
+{
+    while (count > 0) {
+        // stop at first frame that isn't done yet
+        GLsync fence = pending[head].fence;
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         wait ? GLuint64(1000000000) : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(fence);
+
+        // copy out of buffer, flipping to top-to-bottom row order
+        unsigned int w = pending[head].width, h = pending[head].height;
+        ImagePPM *image = new ImagePPM(w, h);
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, bufferIDs[head]);
+        const char *pixels = (const char*)glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, 3*w*h, GL_MAP_READ_BIT);
+        if (pixels) {
+            for(unsigned int y=0; y<h; ++y)
+                memcpy(&(*image)(0, h-1-y), pixels + 3*w*y, 3*w);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+
+        // hand off to writer unless it is too far behind
+        Frame f = { image, pending[head].frame };
+        bool queued = false;
+        if (pixels) {
+            std::lock_guard<std::mutex> guard(queueLock);
+            if (queue.size() < MAX_QUEUE) {
+                queue.push_back(f);
+                queued = true;
+            }
+        }
+        if (queued)
+            queueReady.notify_one();
+        else {
+            delete image;
+            ++dropped;
+        }
+
+        head = (head + 1) % NUM_BUFFERS;
+        --count;
+    }
+}
+
+//
+// writer thread: save queued frames until told to stop
+//
+void Capture::writeFrames()
+{
+    for(;;) {
+        Frame f;
+        {
+            std::unique_lock<std::mutex> guard(queueLock);
+            queueReady.wait(guard,
+                            [this]{ return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;         // stopping and nothing left
+            f = queue.front();
+            queue.pop_front();
+        }
+
+        if (! rawVideo) {
+            // numbered PPM files
+            char name[1024];
+            if (numbered)
+                snprintf(name, sizeof(name), output, f.number);
+            else
+                snprintf(name, sizeof(name), "%s%05u.ppm", output, f.number);
+            if (f.image->write(name))
+                ++written;
+            else
+                ++dropped;
+        }
+        else {
+            // raw stream: every frame must match the first frame's size
+            if (videoWidth == 0) {
+                videoWidth = f.image->width;
+                videoHeight = f.image->height;
+            }
+            if (video && f.image->width == videoWidth
+                && f.image->height == videoHeight
+                && fwrite(f.image->image, sizeof(ImagePPM::color_type),
+                          videoWidth * videoHeight, video)
+                   == videoWidth * videoHeight)
+                ++written;
+            else
+                ++dropped;
+        }
+        delete f.image;
+    }
+}
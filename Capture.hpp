@@ -0,0 +1,83 @@
+// capture rendered frames to disk without stalling rendering
+#ifndef Capture_hpp
+#define Capture_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+struct ImagePPM;
+struct __GLsync;
+
+// Frames are read back into a ring of pixel buffer objects and only
+// mapped several frames later, once their fence says the copy is done.
+// Mapped pixels are handed to a writer thread, so neither the GPU
+// readback nor the file IO blocks the frame. If the ring or writer
+// queue is full, the frame is dropped and counted instead.
+class Capture {
+// private data
+private:
+    // GL pixel buffer ring: one buffer per frame of readback delay
+    enum {NUM_BUFFERS = 3};
+    unsigned int bufferIDs[NUM_BUFFERS];
+    unsigned int bufferSize[NUM_BUFFERS];   // allocated size in bytes
+    struct {
+        __GLsync *fence;        // signaled when readback is complete
+        unsigned int width, height; // frame size
+        unsigned int frame;     // frame number
+    } pending[NUM_BUFFERS];
+    unsigned int head, count;   // oldest pending buffer and number pending
+
+    // frames waiting for the writer thread
+    enum {MAX_QUEUE = 8};
+    struct Frame {
+        ImagePPM *image;        // image data, owned by queue
+        unsigned int number;    // frame number
+    };
+    std::deque<Frame> queue;
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    bool stopping;              // tell writer to finish
+    std::thread writer;
+
+    // output
+    const char *output;         // printf pattern for frame number, or file
+    bool rawVideo;              // single raw stream rather than PPM files
+    bool numbered;              // output has a frame number conversion,
+                                // otherwise it is a prefix for one
+    FILE *video;                // raw video stream
+    unsigned int videoWidth, videoHeight;  // raw video frame size
+    unsigned int frameNumber;   // next frame number to read back
+
+// public data
+public:
+    std::atomic<unsigned int> written;  // frames saved
+    std::atomic<unsigned int> dropped;  // frames lost to a full ring or
+                                        // queue, or that failed to save
+
+// public methods
+public:
+    // capture to numbered PPM files using printf-style pattern with a
+    // single integer conversion, or if rawVideo, to a single stream of
+    // raw RGB frames. Any other name is used as a prefix.
+    Capture(const char *output, bool rawVideo);
+
+    // finish outstanding frames and report statistics
+    ~Capture();
+
+    // read back current frame, call after drawing and before swap
+    void frame(int width, int height);
+
+// private methods
+private:
+    // move any completed readbacks to writer queue, optionally waiting
+    void collect(bool wait);
+
+    // writer thread main loop
+    void writeFrames();
+};
+
+#endif
@@ -0,0 +1,209 @@
+// record where CPU time goes in named zones, on any thread
+
+#include "CpuProfiler.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+namespace {
+    // zones kept per thread; a power of two, so head can wrap
+    enum {RING_SIZE = 1 << 16};
+
+    struct Event {
+        const char *name;
+        unsigned long long start, end;  // ns
+    };
+
+    // an event in a ring, which may be read while being overwritten
+    struct Slot {
+        std::atomic<const char*> name;
+        std::atomic<unsigned long long> start, end;
+    };
+
+    // Written only by its thread, read by whoever saves. Like a seqlock,
+    // writing says which zone is being written before changing its slot,
+    // so a reader can tell which slots may have changed under it.
+    struct Ring {
+        Slot events[RING_SIZE];
+        std::atomic<unsigned int> writing;  // zones started recording
+        std::atomic<unsigned int> head;     // zones ever recorded
+        std::atomic<unsigned int> first;    // oldest zone to save
+        unsigned int id;                    // trace thread id
+        char name[32];
+    };
+
+    // every ring made so far, freed at exit
+    struct RingList {
+        std::mutex lock;
+        std::vector<Ring*> rings;
+        ~RingList() {
+            for(unsigned int i=0; i<rings.size(); ++i)
+                delete rings[i];
+        }
+    } ringList;
+
+    // this thread's ring, and its name until the ring exists
+    thread_local Ring *threadRing = 0;
+    thread_local char threadName[32] = "";
+
+    //
+    // this thread's ring, making it if needed
+    //
+    Ring *ring()
+    {
+        if (threadRing) return threadRing;
+
+        Ring *r = new Ring;
+        r->writing = r->head = r->first = 0;
+        std::lock_guard<std::mutex> lock(ringList.lock);
+        r->id = (unsigned int)ringList.rings.size() + 1;
+        if (threadName[0])
+            strcpy(r->name, threadName);
+        else
+            snprintf(r->name, sizeof(r->name), "thread %u", r->id);
+        ringList.rings.push_back(r);
+        return threadRing = r;
+    }
+}
+
+std::atomic<bool> CpuProfiler::enabled(false);
+const char *CpuProfiler::traceFile = "trace.json";
+
+//
+// steady_clock is monotonic and as cheap as rdtsc where it counts
+// (vDSO on Linux), without rdtsc's calibration or core migration issues
+//
+unsigned long long CpuProfiler::now()
+{
+    return (unsigned long long)
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// claim the next slot, fill it, then publish it. Relaxed stores and
+// fences are plain stores on x86; only the release fence costs on ARM.
+//
+void CpuProfiler::record(const char *name, unsigned long long start,
+                         unsigned long long end)
+{
+    Ring *r = ring();
+    unsigned int h = r->head.load(std::memory_order_relaxed);
+    r->writing.store(h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Slot &s = r->events[h % RING_SIZE];
+    s.name.store(name, std::memory_order_relaxed);
+    s.start.store(start, std::memory_order_relaxed);
+    s.end.store(end, std::memory_order_relaxed);
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+//
+// name used for this thread's ring, now or when it is made
+//
+void CpuProfiler::nameThread(const char *name)
+{
+    strncpy(threadName, name, sizeof(threadName) - 1);
+    if (threadRing)
+        strcpy(threadRing->name, threadName);
+}
+
+//
+// start fresh, or stop and save
+//
+void CpuProfiler::toggle()
+{
+    if (! enabled) {
+        std::lock_guard<std::mutex> lock(ringList.lock);
+        for(unsigned int i=0; i<ringList.rings.size(); ++i) {
+            Ring *r = ringList.rings[i];
+            r->first = r->head.load(std::memory_order_acquire);
+        }
+        enabled = true;
+        fprintf(stderr, "CPU profiler on\n");
+    }
+    else {
+        enabled = false;
+        if (save(traceFile))
+            fprintf(stderr, "CPU profile saved to %s\n", traceFile);
+    }
+}
+
+//
+// write to file
+//
+bool CpuProfiler::save(const char *file)
+{
+    FILE *fp = fopen(file, "w");
+    if (! fp) {
+        fprintf(stderr, "unable to write CPU profile %s\n", file);
+        return false;
+    }
+    write(fp);
+    fclose(fp);
+    return true;
+}
+
+//
+// Chrome trace events: a name for each thread, then one complete ("X")
+// event per zone, in microseconds from the earliest zone
+//
+void CpuProfiler::write(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(ringList.lock);
+
+    // copy each ring, since its thread may still be recording
+    std::vector< std::vector<Event> > copies(ringList.rings.size());
+    unsigned long long origin = ~0ull;
+    for(unsigned int i=0; i<ringList.rings.size(); ++i) {
+        Ring *r = ringList.rings[i];
+        unsigned int end = r->head.load(std::memory_order_acquire);
+        unsigned int begin = r->first.load(std::memory_order_relaxed);
+        if (end - begin > RING_SIZE)
+            begin = end - RING_SIZE;
+        for(unsigned int z=begin; z != end; ++z) {
+            const Slot &s = r->events[z % RING_SIZE];
+            Event e = {s.name.load(std::memory_order_relaxed),
+                       s.start.load(std::memory_order_relaxed),
+                       s.end.load(std::memory_order_relaxed)};
+            copies[i].push_back(e);
+        }
+
+        // drop any the thread started overwriting while we copied. If
+        // we saw any of a new zone's stores, the fences make sure we
+        // also see writing count it.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned int after = r->writing.load(std::memory_order_relaxed);
+        unsigned int lost = after - begin;
+        lost = lost > RING_SIZE ? lost - RING_SIZE : 0;
+        if (lost > copies[i].size()) lost = (unsigned int)copies[i].size();
+        copies[i].erase(copies[i].begin(), copies[i].begin() + lost);
+
+        // zones are in end order, so an outer zone may start earliest
+        for(unsigned int z=0; z<copies[i].size(); ++z)
+            if (copies[i][z].start < origin)
+                origin = copies[i][z].start;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"GLdemo\"}}");
+    for(unsigned int i=0; i<ringList.rings.size(); ++i) {
+        Ring *r = ringList.rings[i];
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}", r->id, r->name);
+        fprintf(out, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+                "\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                r->id, r->id);
+        for(unsigned int z=0; z<copies[i].size(); ++z) {
+            const Event &e = copies[i][z];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                    "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", e.name, r->id,
+                    (e.start - origin) * 1e-3, (e.end - e.start) * 1e-3);
+        }
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
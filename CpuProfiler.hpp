@@ -0,0 +1,62 @@
+// record where CPU time goes in named zones, on any thread
+#ifndef CpuProfiler_hpp
+#define CpuProfiler_hpp
+
+#include <atomic>
+#include <stdio.h>
+
+// A Zone object times its own lifetime: put one at the top of a block
+// to see how long the block takes, each time it runs, on the thread
+// that ran it. Each thread appends finished zones to a ring of its own,
+// so recording takes no locks and shares no cache lines. Once a ring
+// fills, the oldest zones are overwritten. A thread's ring is made the
+// first time it records anything, and kept after the thread exits, so
+// the startup workers still show up in the trace.
+//
+// When disabled, a zone costs one relaxed load and a branch at each
+// end, so zones stay in release builds. save() writes the Chrome trace
+// event format, which chrome://tracing and ui.perfetto.dev open.
+//
+// All static, since zones are anywhere, including code that has no
+// AppContext such as Terrain::getElevation on the simulation thread.
+class CpuProfiler {
+// public types
+public:
+    // time the enclosing block. Names must be string constants.
+    class Zone {
+    private:
+        const char *name;
+        unsigned long long start;   // ns, or 0 if not recording
+    public:
+        explicit Zone(const char *zoneName)
+            : name(zoneName),
+              start(enabled.load(std::memory_order_relaxed) ? now() : 0) {}
+        ~Zone() { if (start) record(name, start, now()); }
+    };
+
+// public data
+public:
+    static std::atomic<bool> enabled;   // recording zones
+    static const char *traceFile;       // where toggle() saves
+
+// public methods
+public:
+    // nanoseconds since some fixed time
+    static unsigned long long now();
+
+    // add a finished zone to this thread's ring
+    static void record(const char *name, unsigned long long start,
+                       unsigned long long end);
+
+    // name this thread in the trace (copied)
+    static void nameThread(const char *name);
+
+    // turn on (clearing old zones) or off (saving to traceFile)
+    static void toggle();
+
+    // write recorded zones as Chrome trace JSON, returning false on error
+    static bool save(const char *file);
+    static void write(FILE *out);
+};
+
+#endif
@@ -0,0 +1,144 @@
+// wait between frames: block when idle, pace frames when active
+
+#include "FramePacer.hpp"
+#include "CpuProfiler.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    // longest wait when idle, so edited shaders are still noticed
+    const double IDLE_TIMEOUT = 0.1;
+}
+
+//
+// start timing from now
+//
+FramePacer::FramePacer(GLFWwindow *window, double fps)
+    : win(window), nextFrame(0), targetFPS(fps),
+      activeTime(0), activeCPU(0), idleTime(0), idleCPU(0),
+      activeFrames(0), frameTimeSq(0)
+{
+    lastTime = time();
+    lastCPU = cpuTime();
+}
+
+//
+// report CPU use
+//
+FramePacer::~FramePacer()
+{
+    fprintf(stderr, "frame pacing: %.0f%% CPU over %.1f s active, "
+            "%.1f%% over %.1f s idle\n",
+            100 * activeUtilization(), activeTime,
+            100 * idleUtilization(), idleTime);
+    if (activeFrames)
+        fprintf(stderr, "frame times: %u active, %.2f ms mean, "
+                "%.2f ms standard deviation\n", activeFrames,
+                1000 * frameTimeMean(), 1000 * frameTimeDeviation());
+}
+
+//
+// spread of active frame times, from the sums kept by wait
+//
+double FramePacer::frameTimeDeviation() const
+{
+    if (activeFrames < 2) return 0;
+    double mean = frameTimeMean();
+    double variance = frameTimeSq / activeFrames - mean * mean;
+    return variance > 0 ? sqrt(variance) : 0;
+}
+
+//
+// wall clock seconds
+//
+double FramePacer::time()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// process CPU seconds, user plus system
+//
+double FramePacer::cpuTime()
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (! GetProcessTimes(GetCurrentProcess(), &created, &exited,
+                          &kernel, &user))
+        return 0;
+    // FILETIME counts 100ns intervals
+    return 1e-7 * ((double(kernel.dwHighDateTime) + double(user.dwHighDateTime))
+                   * 4294967296.0
+                   + double(kernel.dwLowDateTime) + double(user.dwLowDateTime));
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+        + 1e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+//
+// wait for input or the next frame time, then charge everything since
+// the last wait (this frame's work and its wait) to active or idle
+//
+void FramePacer::wait(bool active)
+{
+    CpuProfiler::Zone zone("FramePacer::wait");
+
+    double now = time();
+    double timeout = IDLE_TIMEOUT;
+    if (active) {
+        // no target: go straight on to the next frame
+        timeout = 0;
+        if (targetFPS > 0) {
+            // keep a steady rate, without trying to make up lost frames
+            nextFrame += 1 / targetFPS;
+            if (nextFrame < now)
+                nextFrame = now;
+            timeout = nextFrame - now;
+        }
+    }
+    else
+        nextFrame = now;
+
+    // with a window, any input ends the wait early
+    if (win) {
+        if (timeout > 0)
+            glfwWaitEventsTimeout(timeout);
+        else
+            glfwPollEvents();
+    }
+    else if (timeout > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+
+    now = time();
+    double cpu = cpuTime();
+    if (active) {
+        activeTime += now - lastTime;
+        activeCPU += cpu - lastCPU;
+        ++activeFrames;
+        frameTimeSq += (now - lastTime) * (now - lastTime);
+    }
+    else {
+        idleTime += now - lastTime;
+        idleCPU += cpu - lastCPU;
+    }
+    lastTime = now;
+    lastCPU = cpu;
+}
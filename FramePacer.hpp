@@ -0,0 +1,63 @@
+// wait between frames: block when idle, pace frames when active
+#ifndef FramePacer_hpp
+#define FramePacer_hpp
+
+struct GLFWwindow;
+
+// When nothing is changing, blocks in glfwWaitEventsTimeout until input
+// arrives, waking a few times a second to notice edited shaders. When
+// something is moving, returns for the next frame right away, or at
+// targetFPS if set. Also adds up process CPU time and wall time spent
+// in active and idle frames, to show what each costs, and how evenly
+// spaced active frames are.
+class FramePacer {
+// private data
+private:
+    GLFWwindow *win;            // window to take events from, or null
+    double nextFrame;           // time (in seconds) of next paced frame
+    double lastTime, lastCPU;   // wall and CPU time at end of last wait
+
+// public data
+public:
+    double targetFPS;           // frames per second when active, 0 for
+                                // as fast as swap interval allows
+    double activeTime, activeCPU;   // wall and CPU seconds while active
+    double idleTime, idleCPU;       // wall and CPU seconds while idle
+    unsigned int activeFrames;      // number of active frames
+    double frameTimeSq;             // sum of squared active frame times
+
+// public methods
+public:
+    // pace frames for window (or null if there are no events to wait
+    // for), at targetFPS when active
+    FramePacer(GLFWwindow *win, double targetFPS);
+
+    // report CPU use
+    ~FramePacer();
+
+    // wait until the next frame should be drawn. active if something
+    // is moving or needs drawing every frame
+    void wait(bool active);
+
+    // seconds since some fixed time
+    static double time();
+
+    // CPU seconds used by all threads of this process
+    static double cpuTime();
+
+    // fraction of a CPU used while active or idle
+    double activeUtilization() const {
+        return activeTime > 0 ? activeCPU / activeTime : 0;
+    }
+    double idleUtilization() const {
+        return idleTime > 0 ? idleCPU / idleTime : 0;
+    }
+
+    // mean and standard deviation of active frame times (in seconds)
+    double frameTimeMean() const {
+        return activeFrames ? activeTime / activeFrames : 0;
+    }
+    double frameTimeDeviation() const;
+};
+
+#endif
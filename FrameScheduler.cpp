@@ -0,0 +1,111 @@
+// run deferred GL work between frames within a time budget
+
+#include "FrameScheduler.hpp"
+#include "FramePacer.hpp"
+#include "CpuProfiler.hpp"
+
+#include <stdio.h>
+
+//
+// empty queues
+//
+FrameScheduler::FrameScheduler(double frameBudget)
+    : nextID(1), waitFrames(0), jobsRun(0), jobsCancelled(0),
+      framesDeferred(0), longestJob(0), longestName(0), budget(frameBudget)
+{
+}
+
+//
+// report what ran
+//
+FrameScheduler::~FrameScheduler()
+{
+    if (jobsRun || jobsCancelled)
+        fprintf(stderr, "frame scheduler: %u jobs run, %u cancelled, "
+                "%u frames left work for later, longest %.1f ms (%s)\n",
+                jobsRun, jobsCancelled, framesDeferred, 1000*longestJob,
+                longestName ? longestName : "none");
+}
+
+//
+// queue job at the end of its priority
+//
+unsigned int FrameScheduler::add(const char *name, std::function<void()> work,
+                                 Priority priority)
+{
+    Job job;
+    job.id = nextID++;
+    if (nextID == 0) nextID = 1;
+    job.name = name;
+    job.work = work;
+    queues[priority].push_back(job);
+    return job.id;
+}
+
+//
+// find and remove a queued job
+//
+bool FrameScheduler::cancel(unsigned int id)
+{
+    if (id == 0) return false;
+    for(unsigned int p=0; p<NUM_PRIORITIES; ++p) {
+        for(std::deque<Job>::iterator job = queues[p].begin();
+            job != queues[p].end(); ++job) {
+            if (job->id == id) {
+                queues[p].erase(job);
+                ++jobsCancelled;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//
+// run jobs in priority order until out of time or jobs
+//
+void FrameScheduler::run(double frameStart)
+{
+    bool ranAny = false;
+    for(unsigned int p=0; p<NUM_PRIORITIES; ++p) {
+        while (! queues[p].empty()) {
+            double now = FramePacer::time();
+
+            // out of time, unless this job has waited too long
+            if (now - frameStart >= budget
+                && (ranAny || waitFrames < MAX_WAIT_FRAMES)) {
+                ++framesDeferred;
+                waitFrames = ranAny ? 0 : waitFrames + 1;
+                return;
+            }
+
+            // take job off the queue first, so it may queue more
+            Job job = queues[p].front();
+            queues[p].pop_front();
+            {
+                CpuProfiler::Zone zone(job.name);
+                job.work();
+            }
+            ranAny = true;
+
+            double time = FramePacer::time() - now;
+            if (time > longestJob) {
+                longestJob = time;
+                longestName = job.name;
+            }
+            ++jobsRun;
+        }
+    }
+    waitFrames = 0;
+}
+
+//
+// total across priorities
+//
+unsigned int FrameScheduler::pending() const
+{
+    unsigned int count = 0;
+    for(unsigned int p=0; p<NUM_PRIORITIES; ++p)
+        count += (unsigned int)queues[p].size();
+    return count;
+}
@@ -0,0 +1,68 @@
+// run deferred GL work between frames within a time budget
+#ifndef FrameScheduler_hpp
+#define FrameScheduler_hpp
+
+#include <deque>
+#include <functional>
+
+// GL-thread jobs such as texture uploads and shader rebuilds are queued
+// here instead of run where they are asked for. After each frame is
+// submitted, run() takes jobs, highest priority first and in order
+// within a priority, for as long as the time since the frame started
+// is under budget. Whatever doesn't fit waits for the next frame. A job
+// still queued can be cancelled, for instance when a newer request
+// replaces it. So work can't be put off forever by frames that are
+// always over budget, one job runs regardless after MAX_WAIT_FRAMES.
+// Not thread safe: add, cancel and run all belong to the GL thread.
+class FrameScheduler {
+// public constants
+public:
+    enum Priority {HIGH, NORMAL, LOW, NUM_PRIORITIES};
+
+// private data
+private:
+    enum {MAX_WAIT_FRAMES = 30};
+
+    struct Job {
+        unsigned int id;        // handle returned by add
+        const char *name;       // for reports
+        std::function<void()> work;
+    };
+    std::deque<Job> queues[NUM_PRIORITIES];
+    unsigned int nextID;        // next handle, never 0
+    unsigned int waitFrames;    // frames in a row with nothing run
+
+    // statistics
+    unsigned int jobsRun, jobsCancelled, framesDeferred;
+    double longestJob;          // seconds
+    const char *longestName;    // name of longest job
+
+// public data
+public:
+    double budget;              // seconds from frame start for jobs
+
+// public methods
+public:
+    // run jobs until budget seconds into each frame
+    explicit FrameScheduler(double budget);
+
+    // report what ran
+    ~FrameScheduler();
+
+    // queue a job, returning a handle for cancel
+    unsigned int add(const char *name, std::function<void()> work,
+                     Priority priority = NORMAL);
+
+    // drop a job that hasn't run yet. Returns false if it already ran,
+    // was already cancelled, or id is 0.
+    bool cancel(unsigned int id);
+
+    // run jobs while the frame that started at frameStart (in
+    // FramePacer::time() seconds) is under budget
+    void run(double frameStart);
+
+    // number of jobs waiting
+    unsigned int pending() const;
+};
+
+#endif
@@ -0,0 +1,251 @@
+// skip OpenGL binds that wouldn't change anything
+
+#include "GLState.hpp"
+#include "Metrics.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <map>
+
+namespace {
+    // tracked binding points, and how many of each
+    enum BufferTarget {ARRAY, UNIFORM, PIXEL_PACK, NUM_BUFFER_TARGETS};
+    enum TextureTarget {TEX_2D, TEX_2D_ARRAY, NUM_TEXTURE_TARGETS};
+    enum {MAX_UNITS = 16,       // texture units
+          MAX_INDICES = 16};    // uniform buffer binding points
+
+    // a binding we don't know, so the next bind is always issued
+    const unsigned int UNKNOWN = ~0u;
+
+    // range bound to an indexed binding point
+    struct Range {
+        unsigned int buffer;
+        ptrdiff_t offset, size;
+    };
+
+    struct State {
+        unsigned int program;
+        unsigned int vertexArray;
+        unsigned int buffers[NUM_BUFFER_TARGETS];
+        std::map<unsigned int, unsigned int> elementBuffers; // per VAO
+        Range uniformRanges[MAX_INDICES];
+        unsigned int activeUnit;
+        unsigned int textures[MAX_UNITS][NUM_TEXTURE_TARGETS];
+
+        // calls this frame, and all frames
+        unsigned int issued, elided;
+        unsigned long long totalIssued, totalElided;
+        unsigned int frames;
+
+        // GL starts with nothing bound and unit 0 active
+        State() : program(0), vertexArray(0), activeUnit(0),
+                  issued(0), elided(0), totalIssued(0), totalElided(0),
+                  frames(0) {
+            for(unsigned int t=0; t<NUM_BUFFER_TARGETS; ++t)
+                buffers[t] = 0;
+            for(unsigned int i=0; i<MAX_INDICES; ++i) {
+                Range none = {0, 0, 0};
+                uniformRanges[i] = none;
+            }
+            for(unsigned int u=0; u<MAX_UNITS; ++u)
+                for(unsigned int t=0; t<NUM_TEXTURE_TARGETS; ++t)
+                    textures[u][t] = 0;
+        }
+    } state;
+
+    //
+    // tracked slot for a general buffer target, or 0 if untracked
+    //
+    unsigned int *bufferSlot(unsigned int target)
+    {
+        switch (target) {
+        case GL_ARRAY_BUFFER:           return &state.buffers[ARRAY];
+        case GL_UNIFORM_BUFFER:         return &state.buffers[UNIFORM];
+        case GL_PIXEL_PACK_BUFFER:      return &state.buffers[PIXEL_PACK];
+        case GL_ELEMENT_ARRAY_BUFFER: {
+            // VAO state: a new VAO starts with none
+            std::map<unsigned int, unsigned int>::iterator found =
+                state.elementBuffers.find(state.vertexArray);
+            if (found == state.elementBuffers.end())
+                found = state.elementBuffers.insert(
+                    std::make_pair(state.vertexArray, 0u)).first;
+            return &found->second;
+        }
+        }
+        return 0;
+    }
+
+    //
+    // set *slot to value, returning true if that is a change
+    //
+    bool change(unsigned int *slot, unsigned int value)
+    {
+        if (slot && *slot == value) {
+            ++state.elided;
+            return false;
+        }
+        if (slot) *slot = value;
+        ++state.issued;
+        return true;
+    }
+}
+
+//
+// program in use
+//
+void GLState::useProgram(unsigned int program)
+{
+    if (change(&state.program, program))
+        glUseProgram(program);
+}
+
+//
+// vertex array, which brings its own element buffer binding
+//
+void GLState::bindVertexArray(unsigned int vertexArray)
+{
+    if (change(&state.vertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+//
+// general buffer binding
+//
+void GLState::bindBuffer(unsigned int target, unsigned int buffer)
+{
+    if (change(bufferSlot(target), buffer))
+        glBindBuffer(target, buffer);
+}
+
+//
+// indexed range, which also sets the general binding
+//
+void GLState::bindBufferRange(unsigned int target, unsigned int index,
+                              unsigned int buffer, ptrdiff_t offset,
+                              ptrdiff_t size)
+{
+    if (target == GL_UNIFORM_BUFFER && index < MAX_INDICES) {
+        Range &range = state.uniformRanges[index];
+        if (range.buffer == buffer && range.offset == offset
+            && range.size == size) {
+            ++state.elided;
+            return;
+        }
+        range.buffer = buffer;
+        range.offset = offset;
+        range.size = size;
+    }
+    ++state.issued;
+    glBindBufferRange(target, index, buffer, offset, size);
+
+    unsigned int *slot = bufferSlot(target);
+    if (slot) *slot = buffer;
+}
+
+//
+// texture on a unit, switching units only when needed
+//
+void GLState::bindTexture(unsigned int unit, unsigned int target,
+                          unsigned int texture)
+{
+    unsigned int *slot = 0;
+    if (unit < MAX_UNITS) {
+        if (target == GL_TEXTURE_2D)
+            slot = &state.textures[unit][TEX_2D];
+        else if (target == GL_TEXTURE_2D_ARRAY)
+            slot = &state.textures[unit][TEX_2D_ARRAY];
+    }
+    if (slot && *slot == texture) {
+        ++state.elided;
+        return;
+    }
+
+    if (change(&state.activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    if (change(slot, texture))
+        glBindTexture(target, texture);
+}
+
+//
+// a deleted program stays in use until another replaces it, but once
+// replaced its name may come back, so stop trusting the binding
+//
+void GLState::deleteProgram(unsigned int program)
+{
+    glDeleteProgram(program);
+    if (program && state.program == program)
+        state.program = UNKNOWN;
+}
+
+//
+// GL unbinds deleted buffers from the context and the bound VAO, but
+// not from other VAOs, where the binding is no longer known
+//
+void GLState::deleteBuffers(int n, const unsigned int *buffers)
+{
+    glDeleteBuffers(n, buffers);
+    for(int i=0; i<n; ++i) {
+        if (! buffers[i]) continue;
+        for(unsigned int t=0; t<NUM_BUFFER_TARGETS; ++t)
+            if (state.buffers[t] == buffers[i])
+                state.buffers[t] = 0;
+        for(unsigned int x=0; x<MAX_INDICES; ++x)
+            if (state.uniformRanges[x].buffer == buffers[i])
+                state.uniformRanges[x].buffer = UNKNOWN;
+        std::map<unsigned int, unsigned int>::iterator vao;
+        for(vao = state.elementBuffers.begin();
+            vao != state.elementBuffers.end(); ++vao)
+            if (vao->second == buffers[i])
+                vao->second = vao->first == state.vertexArray ? 0 : UNKNOWN;
+    }
+}
+
+//
+// GL unbinds deleted textures from every unit
+//
+void GLState::deleteTextures(int n, const unsigned int *textures)
+{
+    glDeleteTextures(n, textures);
+    for(int i=0; i<n; ++i) {
+        if (! textures[i]) continue;
+        for(unsigned int u=0; u<MAX_UNITS; ++u)
+            for(unsigned int t=0; t<NUM_TEXTURE_TARGETS; ++t)
+                if (state.textures[u][t] == textures[i])
+                    state.textures[u][t] = 0;
+    }
+}
+
+//
+// roll this frame's counts into the totals
+//
+void GLState::endFrame()
+{
+    Metrics::glCallsIssued.add(state.issued);
+    Metrics::glCallsElided.add(state.elided);
+    state.totalIssued += state.issued;
+    state.totalElided += state.elided;
+    state.issued = state.elided = 0;
+    ++state.frames;
+}
+
+//
+// per frame averages
+//
+double GLState::issuedPerFrame()
+{
+    return state.frames ? double(state.totalIssued) / state.frames : 0;
+}
+
+double GLState::elidedPerFrame()
+{
+    return state.frames ? double(state.totalElided) / state.frames : 0;
+}
+
+void GLState::report(FILE *out)
+{
+    if (state.frames)
+        fprintf(out, "GL state: %.1f binds issued and %.1f elided per frame\n",
+                issuedPerFrame(), elidedPerFrame());
+}
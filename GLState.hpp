@@ -0,0 +1,54 @@
+// skip OpenGL binds that wouldn't change anything
+#ifndef GLState_hpp
+#define GLState_hpp
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Remembers the current program, vertex array, buffer bindings, active
+// texture unit and each unit's textures, and only calls GL when a bind
+// would change one of them. So drawing code binds everything it needs
+// each time, and no longer unbinds afterwards: the next user's binds
+// are elided if they match. Follows GL's rules where state is shared:
+// the element array binding belongs to the vertex array object, and
+// glBindBufferRange also sets the target's general binding. Deleting
+// through here forgets deleted names, since GL may hand them out again.
+//
+// Every bind of these kinds must go through here, or the cache will
+// be wrong. Only for the GL context's thread.
+class GLState {
+// public methods
+public:
+    // glUseProgram
+    static void useProgram(unsigned int program);
+
+    // glBindVertexArray
+    static void bindVertexArray(unsigned int vertexArray);
+
+    // glBindBuffer, for array, element, uniform and pixel pack buffers
+    static void bindBuffer(unsigned int target, unsigned int buffer);
+
+    // glBindBufferRange for uniform blocks
+    static void bindBufferRange(unsigned int target, unsigned int index,
+                                unsigned int buffer, ptrdiff_t offset,
+                                ptrdiff_t size);
+
+    // glActiveTexture then glBindTexture, for 2D and 2D array textures
+    static void bindTexture(unsigned int unit, unsigned int target,
+                            unsigned int texture);
+
+    // delete, forgetting any binding of the deleted names
+    static void deleteProgram(unsigned int program);
+    static void deleteBuffers(int n, const unsigned int *buffers);
+    static void deleteTextures(int n, const unsigned int *textures);
+
+    // after each frame: add this frame's counts to the totals
+    static void endFrame();
+
+    // average calls issued and elided per frame
+    static double issuedPerFrame();
+    static double elidedPerFrame();
+    static void report(FILE *out);
+};
+
+#endif
@@ -4,25 +4,52 @@
 
 #include "AppContext.hpp"
 #include "Input.hpp"
+#include "Simulation.hpp"
+#include "TaskGraph.hpp"
+#include "FrameScheduler.hpp"
+#include "GpuProfiler.hpp"
+#include "CpuProfiler.hpp"
+#include "Metrics.hpp"
+#include "MetricsExporter.hpp"
+#include "GLState.hpp"
 #include "Scene.hpp"
 #include "Terrain.hpp"
 #include "Marker.hpp"
+#include "Capture.hpp"
+#include "Shader.hpp"
+#include "ShaderWatcher.hpp"
+#include "UniformRing.hpp"
+#include "InputLog.hpp"
+#include "Benchmark.hpp"
+#include "Headless.hpp"
+#include "FramePacer.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
 
 ///////
 // Clean up any context data
 AppContext::~AppContext()
 {
     // if any are NULL, deleting a NULL pointer is OK
+    // simulation first, since its thread uses the terrain
+    delete simulation;
     delete scene;
-    delete input;
     delete terrain;
     delete lightmarker;
+    delete capture;
+    delete watcher;
+    delete uniforms;
+    delete inputLog;
+    delete scheduler;           // after terrain, which cancels its jobs
+    delete gpuProfiler;
+    delete exporter;
 }
 
 ///////
@@ -44,8 +71,16 @@ extern "C" {
     {
         AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
 
+        // replay uses the recorded size
+        if (appctx->inputLog && appctx->inputLog->replaying()) return;
+
         appctx->scene->viewport(win);
-        appctx->input->redraw = true;
+        appctx->simulation->resize(appctx->scene->width,
+                                   appctx->scene->height);
+        appctx->redraw = true;
+        if (appctx->inputLog)
+            appctx->inputLog->reshape(appctx->scene->width,
+                                      appctx->scene->height);
     }
 
     //
@@ -54,8 +89,11 @@ extern "C" {
     void mousePress(GLFWwindow *win, int button, int action, int mods)
     {
         AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
+        if (appctx->inputLog && appctx->inputLog->replaying()) return;
+        if (appctx->inputLog)
+            appctx->inputLog->mouseButton(button, action);
 
-        appctx->input->mousePress(win, button, action);
+        appctx->simulation->mouseButton(button, action);
     }
 
     //
@@ -64,8 +102,11 @@ extern "C" {
     void mouseMove(GLFWwindow *win, double x, double y)
     {
         AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
+        if (appctx->inputLog && appctx->inputLog->replaying()) return;
+        if (appctx->inputLog)
+            appctx->inputLog->mouseMove(x, y);
 
-        appctx->input->mouseMove(win, appctx->scene, x,y);
+        appctx->simulation->mouseMove(x, y);
     }
 
     // 
@@ -75,15 +116,28 @@ extern "C" {
     {
         AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
 
-        if (action == GLFW_PRESS)
-            appctx->input->keyPress(win, key, appctx);
-        else if (action == GLFW_RELEASE)
-            appctx->input->keyRelease(win, key);
+        // replaying: only Escape, to stop early
+        if (appctx->inputLog && appctx->inputLog->replaying()) {
+            if (key == GLFW_KEY_ESCAPE)
+                glfwSetWindowShouldClose(win, true);
+            return;
+        }
+
+        if (action == GLFW_PRESS) {
+            if (appctx->inputLog) appctx->inputLog->keyPress(key);
+            if (! Input::commandKey(win, key, appctx))
+                appctx->simulation->keyPress(key);
+        }
+        else if (action == GLFW_RELEASE) {
+            if (appctx->inputLog) appctx->inputLog->keyRelease(key);
+            appctx->simulation->keyRelease(key);
+        }
     }
 }
 
 // initialize GLFW - windows and interaction
-GLFWwindow *initGLFW(AppContext *appctx)
+// hidden windows are only used for their OpenGL context
+GLFWwindow *initGLFW(AppContext *appctx, bool visible)
 {
     // set error callback before init
     glfwSetErrorCallback(winError);
@@ -97,6 +151,7 @@ GLFWwindow *initGLFW(AppContext *appctx)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible);
     GLFWwindow *win = glfwCreateWindow(843, 480, "OpenGL Demo", 0, 0);
     if (! win) {
         glfwTerminate();
@@ -104,10 +159,6 @@ GLFWwindow *initGLFW(AppContext *appctx)
     }
     glfwMakeContextCurrent(win);
 
-    // use GLEW on windows to access modern OpenGL functions
-    glewExperimental = true;
-    glewInit();
-
 	// store context pointer to access application data
     glfwSetWindowUserPointer(win, appctx);
 
@@ -117,58 +168,420 @@ GLFWwindow *initGLFW(AppContext *appctx)
     glfwSetMouseButtonCallback(win, mousePress);
     glfwSetCursorPosCallback(win, mouseMove);
 
-    // set OpenGL state
-    glEnable(GL_DEPTH_TEST);      // tell OpenGL to handle overlapping surfaces
-
     return win;
 }
 
+// save GPU profile if asked for
+void saveGpuProfile(const GpuProfiler &gpu, const char *file)
+{
+    if (! file) return;
+    FILE *fp = fopen(file, "w");
+    if (! fp) {
+        fprintf(stderr, "unable to write GPU profile %s\n", file);
+        return;
+    }
+    gpu.dump(fp);
+    fclose(fp);
+}
+
+// draw one frame into the current framebuffer
+void drawFrame(AppContext &appctx)
+{
+    CpuProfiler::Zone zone("drawFrame");
+    GpuProfiler &gpu = *appctx.gpuProfiler;
+
+    // clear old screen contents
+    {
+        GpuProfiler::Scope scope(gpu, "clear");
+        glClearColor(1.f, 1.f, 1.f, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // draw something
+    appctx.uniforms->beginFrame();
+    appctx.scene->update(*appctx.uniforms);
+    {
+        GpuProfiler::Scope scope(gpu, "terrain");
+        appctx.terrain->draw();
+    }
+    {
+        GpuProfiler::Scope scope(gpu, "marker");
+        appctx.lightmarker->draw(*appctx.uniforms);
+    }
+    appctx.uniforms->endFrame();
+}
+
 int main(int argc, char *argv[])
 {
+    // startup cost is timed from here: GLFW's clock would start later,
+    // and never does for headless benchmarks
+    double startTime = FramePacer::time();
+
     // collected data about application for use in callbacks
     AppContext appctx;
 
-    // set up GLUT and OpenGL
-    GLFWwindow *win = initGLFW(&appctx);
-    if (! win) return 1;
+    // command line options
+    const char *captureName = 0;    // capture output, if any
+    bool captureVideo = false;      // raw video stream or numbered PPMs
+    bool useCache = true;           // use mesh and shader caches
+    const char *logName = 0;        // input log, if any
+    InputLog::Mode logMode = InputLog::RECORD;
+    const char *benchPath = 0;      // benchmark camera path, if any
+    unsigned int benchFrames = 500; // frames to benchmark
+    int benchWidth = 1280, benchHeight = 720;   // benchmark frame size
+    double targetFPS = 0;           // frame rate when active, 0 for no limit
+    int swapInterval = 1;           // screen refreshes per swap (0 = no vsync)
+    bool useThreads = true;         // simulate on a separate thread
+    bool showTimeline = false;      // print startup task timeline
+    double budget = 8;              // ms into a frame for deferred GL work
+    const char *gpuProfileName = 0; // GPU profile output, if any
+    const char *traceName = 0;      // CPU trace output, if any
+    const char *metricsName = 0;    // metrics file or unix:socket, if any
+    for(int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "-capture") == 0 && i+1 < argc)
+            captureName = argv[++i];
+        else if (strcmp(argv[i], "-video") == 0 && i+1 < argc) {
+            captureName = argv[++i];
+            captureVideo = true;
+        }
+        else if (strcmp(argv[i], "-nocache") == 0)
+            useCache = false;
+        else if (strcmp(argv[i], "-record") == 0 && i+1 < argc) {
+            logName = argv[++i];
+            logMode = InputLog::RECORD;
+        }
+        else if (strcmp(argv[i], "-replay") == 0 && i+1 < argc) {
+            logName = argv[++i];
+            logMode = InputLog::REPLAY;
+        }
+        else if (strcmp(argv[i], "-benchmark") == 0 && i+1 < argc)
+            benchPath = argv[++i];
+        else if (strcmp(argv[i], "-frames") == 0 && i+1 < argc)
+            benchFrames = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-fps") == 0 && i+1 < argc)
+            targetFPS = atof(argv[++i]);
+        else if (strcmp(argv[i], "-swap") == 0 && i+1 < argc)
+            swapInterval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-nothreads") == 0)
+            useThreads = false;
+        else if (strcmp(argv[i], "-timeline") == 0)
+            showTimeline = true;
+        else if (strcmp(argv[i], "-budget") == 0 && i+1 < argc)
+            budget = atof(argv[++i]);
+        else if (strcmp(argv[i], "-gpuprofile") == 0 && i+1 < argc)
+            gpuProfileName = argv[++i];
+        else if (strcmp(argv[i], "-trace") == 0 && i+1 < argc)
+            traceName = argv[++i];
+        else if (strcmp(argv[i], "-metrics") == 0 && i+1 < argc)
+            metricsName = argv[++i];
+        else if (strcmp(argv[i], "-size") == 0 && i+1 < argc
+                 && sscanf(argv[i+1], "%dx%d", &benchWidth, &benchHeight) == 2)
+            ++i;
+        else {
+            fprintf(stderr, "usage: %s [options]\n"
+                    "  -capture frame%%05d.ppm  save each frame as a PPM\n"
+                    "  -video file.rgb         save frames as raw rgb24 video\n"
+                    "  -nocache                rebuild mesh and shaders\n"
+                    "  -record input.log       save input for later replay\n"
+                    "  -replay input.log       replay saved input, checking\n"
+                    "                          each frame's view matches\n"
+                    "  -benchmark camera.path  time frames along camera path\n"
+                    "                          without a window, JSON to stdout\n"
+                    "  -frames 500             number of benchmark frames\n"
+                    "  -size 1280x720          benchmark frame size\n"
+                    "  -fps 60                 limit frame rate while moving\n"
+                    "  -swap 1                 swap interval, 0 for no vsync\n"
+                    "  -nothreads              simulate movement on the\n"
+                    "                          drawing thread\n"
+                    "  -timeline               print when each startup task\n"
+                    "                          ran, and the critical path\n"
+                    "  -budget 8               ms into each frame to allow\n"
+                    "                          texture and shader updates\n"
+                    "  -gpuprofile gpu.txt     profile GPU time from the\n"
+                    "                          start, saving it on exit\n"
+                    "                          (or toggle with P)\n"
+                    "  -trace trace.json       record CPU time of each part\n"
+                    "                          of each frame from the start,\n"
+                    "                          saving a Chrome trace on exit\n"
+                    "                          (or toggle with T)\n"
+                    "  -metrics gldemo.prom    write Prometheus metrics to\n"
+                    "                          a file every second, or with\n"
+                    "                          unix:path, serve them there\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    // CPU trace from the start includes startup
+    CpuProfiler::nameThread("main");
+    if (traceName) {
+        CpuProfiler::traceFile = traceName;
+        CpuProfiler::enabled = true;
+    }
+
+    // publish metrics from the start, so startup uploads count
+    if (metricsName) {
+        appctx.exporter = new MetricsExporter(metricsName);
+        if (! appctx.exporter->valid()) return 1;
+    }
+
+    // set up GLFW and OpenGL
+    // benchmarks need no window, so try a headless context first
+    GLFWwindow *win = 0;
+    Headless *headless = 0;
+    if (benchPath) {
+        headless = new Headless;
+        if (! headless->valid()) {
+            delete headless;
+            headless = 0;
+        }
+    }
+    if (! headless) {
+        win = initGLFW(&appctx, benchPath == 0);
+        if (! win) return 1;
+        glfwSwapInterval(benchPath ? 0 : swapInterval);
+    }
+
+    // use GLEW on windows to access modern OpenGL functions
+    glewExperimental = true;
+    glewInit();
+
+    // set OpenGL state
+    glEnable(GL_DEPTH_TEST);      // tell OpenGL to handle overlapping surfaces
 
     // initialize context (after GLFW)
-    appctx.input = new Input;
+    shaderCache(useCache);
+    appctx.uniforms = new UniformRing(64*1024);
     appctx.terrain = new Terrain("terrain.ppm", "pebbles.ppm", 
-                                 "pebbles-norm.ppm", "pebbles-gloss.ppm");
-    appctx.lightmarker = new Marker();
-    appctx.scene = new Scene(win, *appctx.lightmarker);
+                                 "pebbles-norm.ppm", "pebbles-gloss.ppm",
+                                 useCache ? "terrain.mesh" : 0);
+
+    // load terrain and marker, decoding images and building the mesh on
+    // worker threads while this one compiles shaders and uploads
+    int width = benchWidth, height = benchHeight;
+    if (win)
+        glfwGetFramebufferSize(win, &width, &height);
+    TaskGraph startup;
+    unsigned int terrainReady = appctx.terrain->load(startup);
+    unsigned int markerReady = startup.add("marker", [&appctx]{
+            appctx.lightmarker = new Marker();
+        }, TaskGraph::MAIN_THREAD);
+    unsigned int sceneReady = startup.add("scene", [&]{
+            appctx.scene = new Scene(&appctx, width, height,
+                                     *appctx.lightmarker);
+        }, TaskGraph::MAIN_THREAD);
+    startup.depend(sceneReady, terrainReady);
+    startup.depend(sceneReady, markerReady);
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (! startup.run(cores > 1 ? cores - 1 : 0))
+        return 1;
+    if (showTimeline)
+        startup.dump(stderr);
+
+    // later texture and shader updates wait for room between frames
+    appctx.scheduler = new FrameScheduler(budget / 1000);
+    appctx.terrain->scheduler = appctx.scheduler;
+
+    // GPU time per part of each frame
+    appctx.gpuProfiler = new GpuProfiler;
+    appctx.gpuProfiler->enabled = gpuProfileName != 0;
+
+    if (captureName)
+        appctx.capture = new Capture(captureName, captureVideo);
+
+    // input log times come from the frame loop, so can't use a thread
+    // and with only one core, a thread just takes turns with drawing
+    if (logName || std::thread::hardware_concurrency() == 1)
+        useThreads = false;
+    appctx.simulation = new Simulation(*appctx.scene, *appctx.terrain, win,
+                                       useThreads);
+
+    // block between frames when nothing is changing
+    FramePacer pacer(win, targetFPS);
+
+    // benchmark: draw frames along the camera path, then report
+    if (benchPath) {
+        Benchmark *benchmark = new Benchmark(benchPath, benchFrames,
+                                             benchWidth, benchHeight);
+        int status = 1;
+        if (benchmark->valid()) {
+            benchmark->trianglesPerFrame = appctx.terrain->triangles()
+                + appctx.lightmarker->triangles();
+            benchmark->meshSeconds = appctx.terrain->meshTime;
+            benchmark->meshCached = appctx.terrain->meshCached;
+            while (benchmark->beginFrame(*appctx.scene, *appctx.terrain)) {
+                double frameStart = FramePacer::time();
+                appctx.gpuProfiler->beginFrame();
+                drawFrame(appctx);
+                appctx.gpuProfiler->endFrame();
+                if (appctx.capture)
+                    appctx.capture->frame(benchWidth, benchHeight);
+                benchmark->endFrame();
+                if (benchmark->firstFrameSeconds == 0)
+                    benchmark->firstFrameSeconds = FramePacer::time()
+                        - startTime;
+                GLState::endFrame();
+                Metrics::framesDrawn.add();
+                Metrics::frameTime.record(FramePacer::time() - frameStart);
+                pacer.wait(true);
+            }
+
+            // then sit idle for a second, as the interactive loop would
+            double idleEnd = FramePacer::time() + 1;
+            while (FramePacer::time() < idleEnd) {
+                appctx.simulation->update(*appctx.scene, FramePacer::time());
+                pacer.wait(appctx.simulation->active());
+            }
+
+            benchmark->report(stdout, (const char*)glGetString(GL_RENDERER),
+                              pacer);
+            status = 0;
+        }
+
+        // clean up while the GL context still exists
+        delete appctx.simulation;
+        appctx.simulation = 0;
+        delete benchmark;
+        delete appctx.capture;
+        appctx.capture = 0;
+        delete appctx.uniforms;
+        appctx.uniforms = 0;
+        finishShaderCache();
+        saveGpuProfile(*appctx.gpuProfiler, gpuProfileName);
+        GLState::report(stderr);
+        if (CpuProfiler::enabled)
+            CpuProfiler::toggle();
+        delete appctx.gpuProfiler;
+        appctx.gpuProfiler = 0;
+        delete headless;
+        if (win) glfwDestroyWindow(win);
+        glfwTerminate();
+        return status;
+    }
+
+    // reload shaders automatically when they are edited
+    // watch every file read so far, including #included files
+    appctx.watcher = new ShaderWatcher;
+    for(unsigned int i=0; i<numShaderFiles(); ++i)
+        appctx.watcher->watch(shaderFile(i));
+
+    // record or replay input, starting from the initial window size
+    if (logName) {
+        appctx.inputLog = new InputLog(logName, logMode);
+        if (! appctx.inputLog->valid()) return 1;
+        appctx.inputLog->reshape(appctx.scene->width, appctx.scene->height);
+    }
 
 	glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    bool firstFrame = true;
     // loop until GLFW says it's time to quit
     while (!glfwWindowShouldClose(win)) {
-        // check for continuous key updates to view
-        appctx.input->keyUpdate(&appctx);
+        // take the newest view from the simulation
+        // a replayed log supplies both the input and the time
+        // (GLFW's clock, which InputLog's event times also use)
+        double frameStart = FramePacer::time();
+        double now = glfwGetTime();
+        if (appctx.inputLog)
+            now = appctx.inputLog->beginFrame(&appctx, win, now);
+        if (appctx.simulation->update(*appctx.scene, now))
+            appctx.redraw = true;
+
+        // start reloading edited shaders, and use any that are done
+        if (appctx.watcher->changed()) {
+            appctx.terrain->updateShaders();
+            appctx.lightmarker->updateShaders();
+        }
+        bool reloaded = appctx.terrain->pollShaders();
+        reloaded = appctx.lightmarker->pollShaders() || reloaded;
+        if (reloaded) {
+            // edits may have added new #include files
+            for(unsigned int i=0; i<numShaderFiles(); ++i)
+                appctx.watcher->watch(shaderFile(i));
+            appctx.redraw = true;
+        }
 
-        if (appctx.input->redraw) {
+        // when capturing, draw every frame for a steady video frame rate
+        // when logging input, draw every frame so each can be checked
+        bool drew = false;
+        if (appctx.redraw || appctx.capture || appctx.inputLog) {
             // we're handing the redraw now
-            appctx.input->redraw = false;
+            appctx.redraw = false;
+            drew = true;
+
+            appctx.gpuProfiler->beginFrame();
+            drawFrame(appctx);
+            if (appctx.inputLog)
+                appctx.inputLog->endFrame(*appctx.scene);
 
-            // clear old screen contents
-            glClearColor(1.f, 1.f, 1.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // queue readback of what we drew
+            if (appctx.capture)
+                appctx.capture->frame(appctx.scene->width,
+                                      appctx.scene->height);
 
-            // draw something
-            appctx.scene->update();
-            appctx.terrain->draw();
-            appctx.lightmarker->draw();
+            // with this frame submitted, use what is left of the budget
+            appctx.scheduler->run(frameStart);
 
             // show what we drew
-            glfwSwapBuffers(win);
+            {
+                CpuProfiler::Zone zone("glfwSwapBuffers");
+                GpuProfiler::Scope scope(*appctx.gpuProfiler, "swap");
+                glfwSwapBuffers(win);
+            }
+            appctx.gpuProfiler->endFrame();
+            GLState::endFrame();
+            Metrics::framesDrawn.add();
+            Metrics::frameTime.record(FramePacer::time() - frameStart);
+
+            // startup cost
+            if (firstFrame) {
+                firstFrame = false;
+                fprintf(stderr, "first frame after %.1f ms "
+                        "(%u shader programs cached, %u compiled)\n",
+                        1000*(FramePacer::time() - startTime), shaderCacheHits,
+                        shaderCacheMisses);
+            }
         }
 
-        // wait for user input
-        glfwPollEvents();
+        if (! drew)
+            appctx.scheduler->run(frameStart);
+        Metrics::pendingJobs.set(appctx.scheduler->pending());
+
+        // wait for user input, or for the next frame while anything is
+        // moving or every frame is wanted. A threaded simulation wakes
+        // us with each new view, so with none since the last frame
+        // there is nothing to do until it does.
+        bool moving = appctx.simulation->active();
+        if (appctx.simulation->threaded() && ! drew)
+            moving = false;
+        pacer.wait(moving || appctx.capture || appctx.inputLog
+                   || appctx.scheduler->pending());
     }
 	glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 
+    // stop simulating before GLFW goes away
+    delete appctx.simulation;
+    appctx.simulation = 0;
+
+    // finish capture and release fences while the GL context still exists
+    delete appctx.capture;
+    appctx.capture = 0;
+    delete appctx.uniforms;
+    appctx.uniforms = 0;
+    finishShaderCache();
+    saveGpuProfile(*appctx.gpuProfiler, gpuProfileName);
+    GLState::report(stderr);
+    delete appctx.gpuProfiler;
+    appctx.gpuProfiler = 0;
+    if (CpuProfiler::enabled)
+        CpuProfiler::toggle();
+
+    // replay fails if any frame's view differed from the recording
+    int status = 0;
+    if (appctx.inputLog && appctx.inputLog->mismatches)
+        status = 2;
+
     glfwDestroyWindow(win);
     glfwTerminate();
 
-    return 0;
+    return status;
 }
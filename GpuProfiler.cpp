@@ -0,0 +1,171 @@
+// measure GPU time of named parts of each frame
+
+#include "GpuProfiler.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <string.h>
+
+//
+// all query objects up front, so profiling never allocates
+//
+GpuProfiler::GpuProfiler()
+    : frame(0), inFrame(false), numScopes(1), samples(0), dropped(0),
+      enabled(false)
+{
+    names[0] = "frame";
+    memset(times, 0, sizeof(times));
+    for(unsigned int f=0; f<NUM_FRAMES; ++f) {
+        glGenQueries(2 + 2*MAX_MARKS, frames[f].queryIDs);
+        frames[f].numMarks = 0;
+        frames[f].recorded = false;
+    }
+}
+
+//
+// free query objects
+//
+GpuProfiler::~GpuProfiler()
+{
+    for(unsigned int f=0; f<NUM_FRAMES; ++f)
+        glDeleteQueries(2 + 2*MAX_MARKS, frames[f].queryIDs);
+}
+
+//
+// find scope by name: usually the same constant string, so compare
+// pointers before contents
+//
+int GpuProfiler::scopeIndex(const char *name)
+{
+    for(unsigned int s=1; s<numScopes; ++s)
+        if (names[s] == name || strcmp(names[s], name) == 0)
+            return int(s);
+    if (numScopes == MAX_SCOPES)
+        return -1;
+    names[numScopes] = name;
+    return int(numScopes++);
+}
+
+//
+// if the last query is done, they all are: add up each scope's time
+//
+void GpuProfiler::collect(Frame &f)
+{
+    f.recorded = false;
+    GLint available = 0;
+    glGetQueryObjectiv(f.queryIDs[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (! available) {
+        ++dropped;
+        return;
+    }
+
+    GLuint64 stamps[2 + 2*MAX_MARKS];
+    unsigned int numQueries = 2 + 2*f.numMarks;
+    for(unsigned int q=0; q<numQueries; ++q)
+        glGetQueryObjectui64v(f.queryIDs[q], GL_QUERY_RESULT, &stamps[q]);
+
+    // nanoseconds to milliseconds; a scope used twice counts twice
+    float ms[MAX_SCOPES] = {0};
+    ms[0] = float(stamps[1] - stamps[0]) * 1e-6f;
+    for(unsigned int m=0; m<f.numMarks; ++m)
+        ms[f.scope[m]] += float(stamps[3 + 2*m] - stamps[2 + 2*m]) * 1e-6f;
+
+    unsigned int slot = samples % WINDOW;
+    for(unsigned int s=0; s<numScopes; ++s)
+        times[s][slot] = ms[s];
+    ++samples;
+}
+
+//
+// reuse the oldest frame's queries once their results are read
+//
+void GpuProfiler::beginFrame()
+{
+    Frame &f = frames[frame % NUM_FRAMES];
+    if (f.recorded)
+        collect(f);
+    if (! enabled) return;
+
+    f.numMarks = 0;
+    glQueryCounter(f.queryIDs[0], GL_TIMESTAMP);
+    inFrame = true;
+}
+
+//
+// mark frame end; results are read NUM_FRAMES frames from now
+//
+void GpuProfiler::endFrame()
+{
+    if (! inFrame) return;
+    Frame &f = frames[frame % NUM_FRAMES];
+    glQueryCounter(f.queryIDs[1], GL_TIMESTAMP);
+    f.recorded = true;
+    inFrame = false;
+    ++frame;
+}
+
+//
+// timestamp at scope start
+//
+int GpuProfiler::begin(const char *name)
+{
+    if (! inFrame) return -1;
+    Frame &f = frames[frame % NUM_FRAMES];
+    if (f.numMarks == MAX_MARKS) return -1;
+    int scope = scopeIndex(name);
+    if (scope < 0) return -1;
+
+    int mark = int(f.numMarks++);
+    f.scope[mark] = scope;
+    glQueryCounter(f.queryIDs[2 + 2*mark], GL_TIMESTAMP);
+    return mark;
+}
+
+//
+// timestamp at scope end
+//
+void GpuProfiler::end(int mark)
+{
+    if (mark < 0 || ! inFrame) return;
+    Frame &f = frames[frame % NUM_FRAMES];
+    glQueryCounter(f.queryIDs[3 + 2*mark], GL_TIMESTAMP);
+}
+
+//
+// start fresh, or stop and report
+//
+void GpuProfiler::toggle()
+{
+    enabled = ! enabled;
+    if (enabled) {
+        samples = dropped = 0;
+        memset(times, 0, sizeof(times));
+        fprintf(stderr, "GPU profiler on\n");
+    }
+    else
+        dump(stderr);
+}
+
+//
+// one line per scope
+//
+void GpuProfiler::dump(FILE *out) const
+{
+    unsigned int window = WINDOW;
+    unsigned int n = samples < window ? samples : window;
+    fprintf(out, "GPU time over last %u frames (%u dropped)\n", n, dropped);
+    if (n == 0) return;
+    fprintf(out, "  %-12s %8s %8s %8s\n", "scope", "min ms", "avg ms", "max ms");
+    for(unsigned int s=0; s<numScopes; ++s) {
+        float lo = times[s][0], hi = times[s][0], sum = 0;
+        for(unsigned int i=0; i<n; ++i) {
+            float t = times[s][i];
+            if (t < lo) lo = t;
+            if (t > hi) hi = t;
+            sum += t;
+        }
+        fprintf(out, "  %-12s %8.3f %8.3f %8.3f\n", names[s], lo, sum / n, hi);
+    }
+}
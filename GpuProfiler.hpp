@@ -0,0 +1,92 @@
+// measure GPU time of named parts of each frame
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#include <stdio.h>
+
+// Each scope is bracketed by two GL_TIMESTAMP queries (glQueryCounter),
+// so scopes may follow or nest inside each other, and inside a
+// GL_TIME_ELAPSED query such as the benchmark's. Queries for a frame
+// are read back NUM_FRAMES frames later, when the GPU is long done
+// with them, so reading never waits. A frame whose results still
+// aren't ready by then is dropped and counted. Per-scope GPU times for
+// the last WINDOW frames give rolling min/avg/max.
+//
+// When disabled, every call returns right away, so it can stay in
+// release builds.
+class GpuProfiler {
+// public types
+public:
+    // time the GL commands issued during its lifetime
+    class Scope {
+    private:
+        GpuProfiler &profiler;
+        int mark;               // index of this scope's mark, or -1
+    public:
+        Scope(GpuProfiler &gpu, const char *name)
+            : profiler(gpu), mark(gpu.begin(name)) {}
+        ~Scope() { profiler.end(mark); }
+    };
+
+// private data
+private:
+    enum {NUM_FRAMES = 4,       // frames of readback delay
+          MAX_MARKS = 16,       // scopes per frame
+          MAX_SCOPES = 16,      // different scope names
+          WINDOW = 120};        // frames of rolling statistics
+
+    // queries for one frame: 0 at frame start, 1 at frame end, then
+    // two per scope mark
+    struct Frame {
+        unsigned int queryIDs[2 + 2*MAX_MARKS];
+        int scope[MAX_MARKS];   // scope of each mark
+        unsigned int numMarks;
+        bool recorded;          // all queries issued, waiting to read
+    } frames[NUM_FRAMES];
+    unsigned int frame;         // frames begun so far
+    bool inFrame;               // between beginFrame and endFrame
+
+    // per scope rolling times in ms; scope 0 is the whole frame
+    const char *names[MAX_SCOPES];
+    unsigned int numScopes;
+    float times[MAX_SCOPES][WINDOW];
+    unsigned int samples;       // frames read back since reset
+    unsigned int dropped;       // frames not ready in time
+
+// public data
+public:
+    bool enabled;               // issuing queries
+
+// private methods
+private:
+    // index of scope with name, adding it if new, or -1 if full
+    int scopeIndex(const char *name);
+
+    // read back a recorded frame's times, or count it dropped
+    void collect(Frame &f);
+
+// public methods
+public:
+    // create query objects; GL context must be current
+    GpuProfiler();
+
+    // delete query objects
+    ~GpuProfiler();
+
+    // bracket each frame; beginFrame reads back an old frame
+    void beginFrame();
+    void endFrame();
+
+    // start a named scope, returning the mark to pass to end, or -1 if
+    // not recording. Names must be string constants.
+    int begin(const char *name);
+    void end(int mark);
+
+    // turn on (clearing statistics) or off (printing them to stderr)
+    void toggle();
+
+    // write min/avg/max GPU ms for each scope over the window
+    void dump(FILE *out) const;
+};
+
+#endif
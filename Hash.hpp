@@ -0,0 +1,41 @@
+// hashing for cache keys
+#ifndef Hash_hpp
+#define Hash_hpp
+
+#include <stdio.h>
+
+// 64-bit FNV-1a hash, continuing from an earlier hash value
+inline unsigned long long hashBytes(const void *data, unsigned long size,
+                                    unsigned long long hash = 14695981039346656037ull)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    for(unsigned long i=0; i<size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    return hash;
+}
+
+// hash a C string, not including the terminating 0
+inline unsigned long long hashString(const char *str,
+                                     unsigned long long hash = 14695981039346656037ull)
+{
+    for(; *str; ++str)
+        hash = (hash ^ (unsigned char)*str) * 1099511628211ull;
+    return hash;
+}
+
+// hash entire contents of a file, 0 if it can't be read
+inline unsigned long long hashFile(const char *file)
+{
+    FILE *fp = fopen(file, "rb");
+    if (!fp) return 0;
+
+    unsigned long long hash = hashBytes(0, 0);
+    unsigned char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        hash = hashBytes(buffer, (unsigned long)count, hash);
+    fclose(fp);
+    return hash;
+}
+
+#endif
@@ -0,0 +1,95 @@
+// OpenGL context without a window, for benchmarking on servers
+
+#include "Headless.hpp"
+
+#include <stdio.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+//
+// create surfaceless EGL context
+//
+Headless::Headless() : display(0), context(0)
+{
+    // surfaceless platform needs no X11, Wayland or GPU device
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    if (getPlatformDisplay)
+        dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                 EGL_DEFAULT_DISPLAY, 0);
+    EGLint major, minor;
+    if (dpy == EGL_NO_DISPLAY || ! eglInitialize(dpy, &major, &minor)) {
+        fprintf(stderr, "headless: no EGL surfaceless display\n");
+        return;
+    }
+    display = dpy;
+
+    // any config will do since we never draw to an EGL surface, and
+    // the surfaceless platform may not offer any (EGL_KHR_no_config_context)
+    EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint numConfigs = 0;
+    if (! eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "headless: EGL has no desktop OpenGL\n");
+        return;
+    }
+    if (! eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs)
+        || numConfigs < 1)
+        config = EGL_NO_CONFIG_KHR;
+
+    // same version and profile as the window
+    EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 0,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+        EGL_NONE
+    };
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+                                      contextAttribs);
+    if (ctx == EGL_NO_CONTEXT) {
+        fprintf(stderr, "headless: unable to create OpenGL 4.0 context\n");
+        return;
+    }
+    if (! eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+        fprintf(stderr, "headless: unable to use surfaceless context\n");
+        eglDestroyContext(dpy, ctx);
+        return;
+    }
+    context = ctx;
+}
+
+//
+// release context and display
+//
+Headless::~Headless()
+{
+    if (context) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+    }
+    if (display)
+        eglTerminate(display);
+}
+
+#else
+
+//
+// no EGL: caller falls back to a hidden window
+//
+Headless::Headless() : display(0), context(0)
+{
+}
+
+Headless::~Headless()
+{
+}
+
+#endif
@@ -0,0 +1,28 @@
+// OpenGL context without a window, for benchmarking on servers
+#ifndef Headless_hpp
+#define Headless_hpp
+
+// On Linux, uses an EGL surfaceless context (EGL_MESA_platform_surfaceless),
+// which works with no display at all, including Mesa llvmpipe on
+// machines without a GPU. Rendering must go to a framebuffer object.
+// Elsewhere, or if EGL fails, valid() is false and the caller should
+// fall back to a hidden window.
+class Headless {
+// private data
+private:
+    void *display;              // EGLDisplay
+    void *context;              // EGLContext
+
+// public methods
+public:
+    // create an OpenGL 4.0 core context and make it current
+    Headless();
+
+    // release context
+    ~Headless();
+
+    // was the context created?
+    bool valid() const { return context != 0; }
+};
+
+#endif
@@ -9,13 +9,10 @@
 // it would be cleaner to throw/catch errors, but they just print & exit
 
 #include "ImagePPM.hpp"
+#include "MemoryTracker.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 
-// OpenGL, just for loadTexture
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-
 #ifdef _WIN32
 // don't complain if we use standard IO functions instead of windows-only
 #pragma warning( disable: 4996 )
@@ -48,7 +45,8 @@ ImagePPM::ImagePPM(const char *name)
     fgetc(fp);                  // skip final \n before data
     
     // allocate image and read array
-    image = new color_type[width * height];
+    image = MemoryTracker::allocate<color_type>(MemoryTracker::IMAGES,
+                                                width * height);
     fread(image, sizeof(color_type), width * height, fp);
 
     // done!
@@ -59,36 +57,39 @@ ImagePPM::ImagePPM(const char *name)
 // create empty image given size
 //
 ImagePPM::ImagePPM(unsigned int w, unsigned int h)
-    : width(w), height(h), image(new color_type[w*h])
+    : width(w), height(h),
+      image(MemoryTracker::allocate<color_type>(MemoryTracker::IMAGES, w*h))
 {}
 
+//
+// free image data
+//
+ImagePPM::~ImagePPM()
+{
+    MemoryTracker::release(MemoryTracker::IMAGES, image, width * height);
+}
+
 //
 // write image as PPM
+// unlike reading, a failed write isn't fatal: the caller decides
 //
-void ImagePPM::write(const char *name) const
+bool ImagePPM::write(const char *name) const
 {
     // open file
     FILE *fp = fopen(name, "wb");
     if (!fp) {
         fprintf(stderr, "error creating %s\n", name);
-        exit(1);
+        return false;
     }
 
     // write header then data
-    fprintf(fp, "P6\n%d %d\n255\n", width, height);
-    fwrite(image, sizeof(color_type), width * height, fp);
+    bool ok = fprintf(fp, "P6\n%d %d\n255\n", width, height) > 0
+        && fwrite(image, sizeof(color_type), width * height, fp)
+           == width * height;
 
-    // close file
-    fclose(fp);
-}
-
-void ImagePPM::loadTexture(unsigned int bufferID) const
-{
-    glBindTexture(GL_TEXTURE_2D, bufferID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,
-                 GL_RGB, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // close file, which may be when a full disk is noticed
+    ok = (fclose(fp) == 0) && ok;
+    if (! ok)
+        fprintf(stderr, "error writing %s\n", name);
+    return ok;
 }
@@ -19,7 +19,7 @@ public:
     ImagePPM(unsigned int width, unsigned int height);
 
     // destroy when done
-    ~ImagePPM() { delete[] image; }
+    ~ImagePPM();
 
     // access a pixel as ImagePPM(x,y)
     color_type operator()(unsigned int tx, unsigned int ty) const {
@@ -29,11 +29,8 @@ public:
         return image[ty*width + tx];
     }
 
-    // write image as a PPM
-    void write(const char *filename) const;
-
-    // load texture into an OpenGL texture
-    void loadTexture(unsigned int bufferID) const;
+    // write image as a PPM, returning false if it couldn't be saved
+    bool write(const char *filename) const;
 };
 
 #endif
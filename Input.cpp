@@ -5,6 +5,10 @@
 #include "Scene.hpp"
 #include "Terrain.hpp"
 #include "Marker.hpp"
+#include "GpuProfiler.hpp"
+#include "CpuProfiler.hpp"
+#include "Metrics.hpp"
+#include "MemoryTracker.hpp"
 #include "Vec.inl"
 
 // using core modern OpenGL
@@ -17,12 +21,21 @@
 #define F_PI 3.1415926f
 #endif
 
+namespace {
+    // simulation time step (in seconds)
+    const float STEP = 1.f/120;
+
+    // most steps to catch up in one update
+    const int MAX_STEPS = 8;
+}
+
 //
 // called when a mouse button is pressed. 
 // Remember where we were, and what mouse button it was.
 //
-void Input::mousePress(GLFWwindow *win, int b, int action)
+void Input::mousePress(int b, int action)
 {
+    Metrics::inputEvents.add();
     if (action == GLFW_PRESS) {
         // hide cursor, record button
         button = b;
@@ -37,27 +50,29 @@ void Input::mousePress(GLFWwindow *win, int b, int action)
 // called when the mouse moves
 // use difference between oldX,oldY and x,y to define a rotation
 //
-void Input::mouseMove(GLFWwindow *win, Scene *scene, double x, double y)
+void Input::mouseMove(Scene &scene, double x, double y)
 {
+    Metrics::inputEvents.add();
+
     // record differences & update last position
     float dx = float(x - oldX);
     float dy = float(y - oldY);
 
 	// Update forward vector and right vector
 	if (isJumping) {
-		orientationQ -= F_PI * dx / float(scene->width);
+		orientationQ -= F_PI * dx / float(scene.width);
 	} else {
-		scene->orientation -= F_PI * dx / float(scene->width);
+		scene.orientation -= F_PI * dx / float(scene.width);
 	}
 
     // rotation angle, scaled so across the window = one rotation
-    scene->viewSph.x += F_PI * dx / float(scene->width);
-    scene->viewSph.y += 0.5f*F_PI * dy / float(scene->height);
+    scene.viewSph.x += F_PI * dx / float(scene.width);
+    scene.viewSph.y += 0.5f*F_PI * dy / float(scene.height);
 	
-	if (scene->viewSph.y > 0.45f * F_PI) { scene->viewSph.y = 0.45f * F_PI; }
-	if (scene->viewSph.y < -0.45f * F_PI) { scene->viewSph.y = -0.45f * F_PI; }
+	if (scene.viewSph.y > 0.45f * F_PI) { scene.viewSph.y = 0.45f * F_PI; }
+	if (scene.viewSph.y < -0.45f * F_PI) { scene.viewSph.y = -0.45f * F_PI; }
 
-    scene->view();
+    scene.view();
 
     // tell GLFW that something has changed and we must redraw
     redraw = true;
@@ -69,10 +84,11 @@ void Input::mouseMove(GLFWwindow *win, Scene *scene, double x, double y)
 }
 
 //
-// called when any key is pressed
+// called when a movement key is pressed
 //
-void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
+void Input::keyPress(int key)
 {
+    Metrics::inputEvents.add();
     switch (key) {
     case 'A':                   // rotate left
 		if (isJumping) {
@@ -80,7 +96,6 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
 		} else {
 			sideRate -= 100.f;
 		}
-        updateTime = glfwGetTime();
         redraw = true;          // need to redraw
         break;
 
@@ -90,7 +105,6 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
 		} else {
 			sideRate += 100.f;
 		}
-        updateTime = glfwGetTime();
         redraw = true;          // need to redraw
         break;
 
@@ -100,7 +114,6 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
 		} else {
 			forwardRate += 100.f;
 		}
-        updateTime = glfwGetTime();
         redraw = true;          // need to redraw
         break;
 
@@ -110,18 +123,6 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
 		} else {
 			forwardRate -= 100.f;
 		}
-        updateTime = glfwGetTime();
-        redraw = true;          // need to redraw
-        break;
-
-    case 'F':                   // toggle fog on or off
-        appctx->scene->sdata.fog = 1 - appctx->scene->sdata.fog;
-        redraw = true;          // need to redraw
-        break;
-
-    case 'R':                   // reload shaders
-        appctx->terrain->updateShaders();
-        appctx->lightmarker->updateShaders();
         redraw = true;          // need to redraw
         break;
 
@@ -129,22 +130,60 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
 		if (!isJumping) {
 			isJumping = true;
 			initJump = true;
-			jumpTime = glfwGetTime();
 			redraw = true;          // need to redraw
 		}
         break;
+    }
+}
+
+//
+// called when any key is pressed, before keyPress. These keys change
+// what is drawn rather than the view, so are handled where drawing
+// happens.
+//
+bool Input::commandKey(GLFWwindow *win, int key, AppContext *appctx)
+{
+    switch (key) {
+    case 'F':                   // toggle fog on or off
+        appctx->terrain->features ^= Terrain::FOG_FEATURE;
+        appctx->redraw = true;  // need to redraw
+        return true;
+
+    case 'M':                   // print memory use
+        MemoryTracker::report(stderr);
+        return true;
+
+    case 'N':                   // toggle normal map on or off
+        appctx->terrain->features ^= Terrain::NORMALMAP_FEATURE;
+        appctx->redraw = true;  // need to redraw
+        return true;
+
+    case 'P':                   // GPU profile on, or off and report
+        appctx->gpuProfiler->toggle();
+        return true;
+
+    case 'T':                   // CPU trace on, or off and save
+        CpuProfiler::toggle();
+        return true;
+
+    case 'R':                   // reload shaders (swapped in when ready)
+        appctx->terrain->updateShaders();
+        appctx->lightmarker->updateShaders();
+        return true;
 
     case GLFW_KEY_ESCAPE:       // Escape: exit
         glfwSetWindowShouldClose(win, true);
-        break;
+        return true;
     }
+    return false;
 }
 
 //
 // called when any key is released
 //
-void Input::keyRelease(GLFWwindow *win, int key)
+void Input::keyRelease(int key)
 {
+    Metrics::inputEvents.add();
     switch (key) {
     case 'A':         // stop moving left
 		if (isJumping) {
@@ -178,14 +217,18 @@ void Input::keyRelease(GLFWwindow *win, int key)
 }
 
 //
-// update view if necessary based on a/d keys
+// advance the simulation by one STEP: move with the a/d/w/s rates and
+// follow the jump parabola. Only depends on the previous state and
+// input, so the same inputs always give the same path.
 //
-void Input::keyUpdate(AppContext *appctx)
+void Input::step(Scene &scene, const Terrain &terrain)
 {
+    Metrics::simulationSteps.add();
+
 	float elevation, theta_xz, theta_yz;
-    double now = glfwGetTime();
+    Vec3f &position = current.position;
 
-	appctx->terrain->getElevation(appctx->scene->positionSph.x, appctx->scene->positionSph.y, elevation, theta_xz, theta_yz);
+	terrain.getElevation(position.x, position.y, elevation, theta_xz, theta_yz);
 
     if (sideRate != 0 || forwardRate != 0) {
 		float sRate = sideRate, fRate = forwardRate;
@@ -195,37 +238,33 @@ void Input::keyUpdate(AppContext *appctx)
 			fRate = fRate * sqrt2 / 2;
 		}
 
-        double dt = (now - updateTime);
-		
-		Vec2f forwardXY = normalize(vec2<float>(cosf(appctx->scene->orientation), sinf(appctx->scene->orientation)));
-
-        // update pan based on time elapsed since last update
-        // ensures uniform rate of change
-        appctx->scene->positionSph.x += float(fRate * forwardXY.x * dt);
-        appctx->scene->positionSph.y += float(fRate * forwardXY.y * dt);
-        appctx->scene->positionSph.x += float(sRate * forwardXY.y * dt);
-        appctx->scene->positionSph.y += float(sRate * -forwardXY.x * dt);
+		Vec2f forwardXY = normalize(vec2<float>(cosf(scene.orientation), sinf(scene.orientation)));
+
+        // fixed time per step ensures uniform rate of change
+        position.x += fRate * forwardXY.x * STEP;
+        position.y += fRate * forwardXY.y * STEP;
+        position.x += sRate * forwardXY.y * STEP;
+        position.y += sRate * -forwardXY.x * STEP;
 		
 		// move view to opposite side of traversal area if POV moves beyond the edge in either direction
-		if (appctx->scene->positionSph.x >= 256.f) { appctx->scene->positionSph.x -= 512.f; }
-		if (appctx->scene->positionSph.x <= -256.f) { appctx->scene->positionSph.x += 512.f; }
-		if (appctx->scene->positionSph.y >= 256.f) { appctx->scene->positionSph.y -= 512.f; }
-		if (appctx->scene->positionSph.y <= -256.f) { appctx->scene->positionSph.y += 512.f; }
+		if (position.x >= 256.f) { position.x -= 512.f; }
+		if (position.x <= -256.f) { position.x += 512.f; }
+		if (position.y >= 256.f) { position.y -= 512.f; }
+		if (position.y <= -256.f) { position.y += 512.f; }
 
 		// Set height based on elevation at position x, y
-		appctx->terrain->getElevation(appctx->scene->positionSph.x, appctx->scene->positionSph.y, elevation, theta_xz, theta_yz);
-
-        // changing, so will need to start another draw
-        redraw = true;
+		terrain.getElevation(position.x, position.y, elevation, theta_xz, theta_yz);
     }
 
 	if (isJumping) {
 		if (initJump) {
 			initialElevation = elevation;
+			jumpTime = 0;
 			initJump = false;
 		}
 
-		double jump_dt = (now - jumpTime);
+		float jump_dt = float(jumpTime);
+		jumpTime += STEP;
 
 		float jumpElevation = initialElevation + 75.f*jump_dt - 125.f*jump_dt*jump_dt/2;
 
@@ -241,26 +280,88 @@ void Input::keyUpdate(AppContext *appctx)
 			}
 		} else {
 			isJumping = false;
-			appctx->scene->orientation += orientationQ;
+			scene.orientation += orientationQ;
 			forwardRate += forwardRateQ;
 			sideRate += sideRateQ;
 			orientationQ = 0.f;
 			forwardRateQ = 0.f;
 			sideRateQ = 0.f;
 		}
-
-		redraw = true;
 	}
 
-	if (redraw) {
-		appctx->scene->positionSph.z = elevation;
-		appctx->scene->alignmentSph.x = theta_xz;
-		appctx->scene->alignmentSph.y = theta_yz;
-
-		// Update View
-        appctx->scene->view();
-	}
+    position.z = elevation;
+    current.alignment = vec2<float>(theta_xz, theta_yz);
+}
 
-    // remember time for next update
+//
+// run as many fixed steps as fit in the time since the last update,
+// then show the view part way from the previous step to the current
+// one, by the fraction of a step left over. Drawing lags the
+// simulation by up to one step, but moves smoothly at any frame rate.
+//
+void Input::keyUpdate(Scene &scene, const Terrain &terrain, double now)
+{
+    CpuProfiler::Zone zone("Input::keyUpdate");
+
+    // start from the scene's initial view
+    if (updateTime < 0) {
+        current.position = scene.positionSph;
+        current.alignment = scene.alignmentSph;
+        previous = current;
+        updateTime = now;
+    }
+    accumulator += now - updateTime;
     updateTime = now;
+
+    // nothing was moving, so movement from new input starts now rather
+    // than back when the loop last went idle
+    if (settled)
+        accumulator = fmod(accumulator, double(STEP));
+
+    // after a stall, drop the time we can't catch up on rather than
+    // making the next frame slower still
+    if (accumulator > MAX_STEPS * STEP)
+        accumulator = MAX_STEPS * STEP;
+
+    while (accumulator >= STEP) {
+        previous = current;
+        step(scene, terrain);
+        accumulator -= STEP;
+    }
+
+    // interpolate, except when wrapping to the other side
+    float t = float(accumulator / STEP);
+    Vec3f position = current.position;
+    Vec2f alignment = current.alignment;
+    Vec3f move = current.position - previous.position;
+    if (fabsf(move.x) < 256.f && fabsf(move.y) < 256.f) {
+        position = lerp(previous.position, current.position, t);
+        alignment = lerp(previous.alignment, current.alignment, t);
+    }
+
+    // only redraw if that moved the view
+    if (position.x != scene.positionSph.x
+        || position.y != scene.positionSph.y
+        || position.z != scene.positionSph.z
+        || alignment.x != scene.alignmentSph.x
+        || alignment.y != scene.alignmentSph.y) {
+        scene.positionSph = position;
+        scene.alignmentSph = alignment;
+        scene.view();
+        redraw = true;
+    }
+    settled = ! active();
+}
+
+//
+// moving, jumping, or still drawing between two different steps
+//
+bool Input::active() const
+{
+    return sideRate != 0 || forwardRate != 0 || isJumping
+        || current.position.x != previous.position.x
+        || current.position.y != previous.position.y
+        || current.position.z != previous.position.z
+        || current.alignment.x != previous.alignment.x
+        || current.alignment.y != previous.alignment.y;
 }
@@ -2,7 +2,10 @@
 #ifndef Input_hpp
 #define Input_hpp
 
+#include "Vec.hpp"
+
 class Scene;
+class Terrain;
 struct AppContext;
 struct GLFWwindow;
 
@@ -12,15 +15,28 @@ private:
     int button, oldButton;      // which mouse button was pressed?
     double oldX, oldY;          // location of mouse at last event
 
+    // simulated point of view, interpolated for drawing
+    struct State {
+        Vec3f position;         // Scene::positionSph
+        Vec2f alignment;        // Scene::alignmentSph
+    };
+    State previous, current;    // last two simulation steps
+
     double updateTime;          // time (in seconds) of last update
+    double accumulator;         // time not yet simulated
+    bool settled;               // nothing was moving at last update
     float sideRate, forwardRate;    // for key change, orbiting rate in radians/sec
 	float sideRateQ, forwardRateQ;  // for tracking movement change while jumping
 	float orientationQ;				// for tracking orientation change while jumping
 
-	double jumpTime;			// time (in seconds) of start of jump
+	double jumpTime;			// simulated time (in seconds) since start of jump
 	bool isJumping, initJump;	// tracking jump and jump prep
 	float initialElevation;		// elevation at the start of the jump
 
+// private methods
+private:
+    // advance simulation by one fixed time step
+    void step(Scene &scene, const Terrain &terrain);
 
 // public data
 public:
@@ -29,24 +45,34 @@ public:
 // public methods
 public:
     // initialize
-    Input() : button(-1), oldButton(-1), oldX(0), oldY(0), orientationQ(0),
+    Input() : button(-1), oldButton(-1), oldX(0), oldY(0),
+              updateTime(-1), accumulator(0), settled(true),
               sideRate(0), forwardRate(0), sideRateQ(0), forwardRateQ(0),
-			  redraw(true), isJumping(false), initJump(false) {}
+              orientationQ(0), jumpTime(0), isJumping(false), initJump(false),
+              initialElevation(0), redraw(true) {}
 
     // handle mouse press / release
-    void mousePress(GLFWwindow *win, int button, int action);
+    void mousePress(int button, int action);
+
+    // handle mouse motion, turning the view in scene
+    void mouseMove(Scene &scene, double x, double y);
+
+    // handle movement key press
+    void keyPress(int key);
 
-    // handle mouse motion
-    void mouseMove(GLFWwindow *win, Scene *scene, double x, double y);
+    // handle movement key release
+    void keyRelease(int key);
 
-    // handle key press
-    void keyPress(GLFWwindow *win, int key, AppContext *ctx);
+    // handle keys that control the application rather than the view:
+    // toggles, shader reload and exit. Returns true if key was one.
+    static bool commandKey(GLFWwindow *win, int key, AppContext *ctx);
 
-    // handle key release
-    void keyRelease(GLFWwindow *win, int key);
+    // run fixed simulation steps up to time now (in seconds), then
+    // update scene view (if necessary) between the last two steps
+    void keyUpdate(Scene &scene, const Terrain &terrain, double now);
 
-    // update view (if necessary) based on key input
-    void keyUpdate(AppContext *ctx);
+    // true while moving or jumping, so keyUpdate should run every frame
+    bool active() const;
 };
 
 #endif
@@ -0,0 +1,245 @@
+// record input events to a file, or replay them in place of live input
+
+#include "InputLog.hpp"
+#include "AppContext.hpp"
+#include "Input.hpp"
+#include "Simulation.hpp"
+#include "Scene.hpp"
+#include "Hash.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+// log file format: header, then for each event a one byte Event type,
+// the double timestamp and the part of the Record union that event
+// uses. Bump the version whenever the layout or the meaning of the
+// recorded events changes.
+namespace {
+    const char INPUT_LOG_MAGIC[4] = {'G','I','N','P'};
+    const unsigned int INPUT_LOG_VERSION = 1;
+
+    struct InputLogHeader {
+        char magic[4];          // INPUT_LOG_MAGIC
+        unsigned int version;   // INPUT_LOG_VERSION
+    };
+}
+
+//
+// open log and check or write header
+//
+InputLog::InputLog(const char *name, Mode m)
+    : file(name), fp(0), frameDone(false),
+      mode(m), frames(0), mismatches(0), firstMismatch(0)
+{
+    memset(&frameRecord, 0, sizeof(frameRecord));
+
+    InputLogHeader header;
+    if (mode == RECORD) {
+        fp = fopen(file, "wb");
+        memcpy(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic));
+        header.version = INPUT_LOG_VERSION;
+        if (fp && fwrite(&header, sizeof(header), 1, fp) != 1) {
+            fclose(fp);
+            fp = 0;
+        }
+        if (!fp)
+            fprintf(stderr, "error creating input log %s\n", file);
+    }
+    else {
+        fp = fopen(file, "rb");
+        bool ok = fp && fread(&header, sizeof(header), 1, fp) == 1
+            && memcmp(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic)) == 0
+            && header.version == INPUT_LOG_VERSION;
+        if (fp && !ok) {
+            fclose(fp);
+            fp = 0;
+        }
+        if (!fp)
+            fprintf(stderr, "error reading input log %s\n", file);
+    }
+}
+
+//
+// close log and report
+//
+InputLog::~InputLog()
+{
+    if (!fp) return;
+    bool ok = fclose(fp) == 0;
+
+    if (mode == RECORD) {
+        if (ok)
+            fprintf(stderr, "input log: %u frames recorded to %s\n",
+                    frames, file);
+        else
+            fprintf(stderr, "error writing input log %s\n", file);
+    }
+    else if (mismatches)
+        fprintf(stderr, "input log: %u of %u frames replayed from %s "
+                "did not match, starting at frame %u\n",
+                mismatches, frames, file, firstMismatch);
+    else
+        fprintf(stderr, "input log: %u frames replayed from %s, all match\n",
+                frames, file);
+}
+
+//
+// payload bytes for each event type
+//
+unsigned int InputLog::payloadSize(Event type)
+{
+    Record r;
+    switch (type) {
+    case KEY_PRESS:
+    case KEY_RELEASE:   return sizeof(r.key);
+    case MOUSE_BUTTON:  return sizeof(r.button);
+    case MOUSE_MOVE:    return sizeof(r.move);
+    case RESHAPE:       return sizeof(r.reshape);
+    case FRAME:         return sizeof(r.frame);
+    default:            return 0;
+    }
+}
+
+//
+// write or read one record
+//
+void InputLog::write(Event type, const Record &record)
+{
+    unsigned char t = (unsigned char)type;
+    fwrite(&t, 1, 1, fp);
+    fwrite(&record.time, sizeof(record.time), 1, fp);
+    fwrite(&record.key, payloadSize(type), 1, fp);
+}
+
+bool InputLog::read(Event &type, Record &record)
+{
+    unsigned char t;
+    if (fread(&t, 1, 1, fp) != 1 || t >= NUM_EVENTS) return false;
+    type = Event(t);
+    return fread(&record.time, sizeof(record.time), 1, fp) == 1
+        && fread(&record.key, payloadSize(type), 1, fp) == 1;
+}
+
+//
+// record events as they arrive
+//
+void InputLog::keyPress(int key)
+{
+    if (mode != RECORD || !fp) return;
+    Record r;
+    r.time = glfwGetTime();
+    r.key.code = key;
+    write(KEY_PRESS, r);
+}
+
+void InputLog::keyRelease(int key)
+{
+    if (mode != RECORD || !fp) return;
+    Record r;
+    r.time = glfwGetTime();
+    r.key.code = key;
+    write(KEY_RELEASE, r);
+}
+
+void InputLog::mouseButton(int button, int action)
+{
+    if (mode != RECORD || !fp) return;
+    Record r;
+    r.time = glfwGetTime();
+    r.button.id = button;
+    r.button.action = action;
+    write(MOUSE_BUTTON, r);
+}
+
+void InputLog::mouseMove(double x, double y)
+{
+    if (mode != RECORD || !fp) return;
+    Record r;
+    r.time = glfwGetTime();
+    r.move.x = x;
+    r.move.y = y;
+    write(MOUSE_MOVE, r);
+}
+
+void InputLog::reshape(int width, int height)
+{
+    if (mode != RECORD || !fp) return;
+    Record r;
+    r.time = glfwGetTime();
+    r.reshape.width = width;
+    r.reshape.height = height;
+    write(RESHAPE, r);
+}
+
+//
+// start a frame: when replaying, apply everything up to the next FRAME
+// record through the same Simulation and Scene calls the GLFW callbacks use
+//
+double InputLog::beginFrame(AppContext *appctx, GLFWwindow *win, double now)
+{
+    frameRecord.time = now;
+    if (mode != REPLAY || !fp || frameDone) return frameRecord.time;
+
+    Event type;
+    Record r;
+    while (read(type, r)) {
+        switch (type) {
+        case KEY_PRESS:
+            if (! Input::commandKey(win, r.key.code, appctx))
+                appctx->simulation->keyPress(r.key.code);
+            break;
+        case KEY_RELEASE:
+            appctx->simulation->keyRelease(r.key.code);
+            break;
+        case MOUSE_BUTTON:
+            appctx->simulation->mouseButton(r.button.id, r.button.action);
+            break;
+        case MOUSE_MOVE:
+            appctx->simulation->mouseMove(r.move.x, r.move.y);
+            break;
+        case RESHAPE:
+            appctx->scene->viewport(r.reshape.width, r.reshape.height);
+            appctx->simulation->resize(r.reshape.width, r.reshape.height);
+            appctx->redraw = true;
+            break;
+        case FRAME:
+            frameRecord = r;
+            return frameRecord.time;
+        default:
+            break;
+        }
+    }
+
+    // out of frames: done
+    frameDone = true;
+    glfwSetWindowShouldClose(win, true);
+    return frameRecord.time;
+}
+
+//
+// end a frame: record checksum of the view, or compare it
+//
+void InputLog::endFrame(const Scene &scene)
+{
+    if (!fp || frameDone) return;
+
+    ++frames;
+    unsigned long long checksum =
+        hashBytes(&scene.sdata.viewmat, sizeof(scene.sdata.viewmat));
+    if (mode == RECORD) {
+        frameRecord.frame.checksum = checksum;
+        write(FRAME, frameRecord);
+    }
+    else if (checksum != frameRecord.frame.checksum) {
+        if (mismatches++ == 0)
+            firstMismatch = frames;
+    }
+}
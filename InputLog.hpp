@@ -0,0 +1,90 @@
+// record input events to a file, or replay them in place of live input
+#ifndef InputLog_hpp
+#define InputLog_hpp
+
+#include <stdio.h>
+
+struct AppContext;
+struct GLFWwindow;
+class Scene;
+
+// The log is a stream of the GLFW input events the viewer handles,
+// each with its glfwGetTime timestamp, and a FRAME record at the end of
+// each frame with the time given to Input::keyUpdate and a checksum of
+// the view matrix. Replay feeds the events back through Input and uses
+// the recorded frame times as the clock, so each frame should produce
+// exactly the same view; any frame that doesn't is counted. Both need
+// the Simulation to run synchronously, on the frame's clock.
+class InputLog {
+// public types
+public:
+    enum Mode { RECORD, REPLAY };
+    enum Event { KEY_PRESS, KEY_RELEASE, MOUSE_BUTTON, MOUSE_MOVE, RESHAPE,
+                 FRAME, NUM_EVENTS };
+
+// private data
+private:
+    // one event, as stored in the file after a one byte Event type
+    struct Record {
+        double time;            // glfwGetTime when the event arrived
+        union {
+            struct { int code; } key;
+            struct { int id, action; } button;
+            struct { double x, y; } move;
+            struct { int width, height; } reshape;
+            struct { unsigned long long checksum; } frame;
+        };
+    };
+
+    const char *file;           // log file name
+    FILE *fp;                   // open log, or null
+    Record frameRecord;         // current frame
+    bool frameDone;             // end of log reached
+
+// public data
+public:
+    Mode mode;
+    unsigned int frames;        // frames recorded or replayed
+    unsigned int mismatches;    // replayed frames with a different view
+    unsigned int firstMismatch; // frame number of first mismatch
+
+// public methods
+public:
+    // open log file for recording or replay
+    InputLog(const char *file, Mode mode);
+
+    // close file and report replay results
+    ~InputLog();
+
+    // was the log opened successfully?
+    bool valid() const { return fp != 0; }
+
+    // replaying: live input should be ignored
+    bool replaying() const { return mode == REPLAY; }
+
+    // record an event (ignored when replaying)
+    void keyPress(int key);
+    void keyRelease(int key);
+    void mouseButton(int button, int action);
+    void mouseMove(double x, double y);
+    void reshape(int width, int height);
+
+    // start a frame at time now. When replaying, applies this frame's
+    // events, and returns the recorded time to use in place of now.
+    // Closes the window at the end of the log.
+    double beginFrame(AppContext *ctx, GLFWwindow *win, double now);
+
+    // end frame after the scene is updated: record or check its view
+    void endFrame(const Scene &scene);
+
+// private methods
+private:
+    // write one record, or read the next one
+    void write(Event type, const Record &record);
+    bool read(Event &type, Record &record);
+
+    // payload size in file for each event type
+    static unsigned int payloadSize(Event type);
+};
+
+#endif
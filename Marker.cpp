@@ -2,6 +2,11 @@
 
 #include "Marker.hpp"
 #include "AppContext.hpp"
+#include "UniformRing.hpp"
+#include "CpuProfiler.hpp"
+#include "Metrics.hpp"
+#include "MemoryTracker.hpp"
+#include "GLState.hpp"
 #include "Vec.inl"
 #include "MatPair.inl"
 
@@ -40,29 +45,30 @@ Marker::Marker()
     indices[7] = vec3<unsigned int>(1, 3, 4);
 
     // load vertex and index array to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+    // element buffer binding is part of the vertex array
+    GLState::bindVertexArray(varrayIDs[TERRAIN_VARRAY]);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
     glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), vert, GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
                  numtri*sizeof(unsigned int[3]), indices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    // create uniform buffer objects
-    glBindBuffer(GL_UNIFORM_BUFFER, bufferIDs[UNIFORM_BUFFER]);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(ModelData), 0, GL_STREAM_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, AppContext::MODEL_UNIFORMS,
-                     bufferIDs[UNIFORM_BUFFER]);
-
-    // initial shader load
-    shaderParts[0].id = glCreateShader(GL_VERTEX_SHADER);
+    MemoryTracker::bufferData(MemoryTracker::MARKER,
+                              bufferIDs[POSITION_BUFFER],
+                              numvert*sizeof(Vec3f));
+    MemoryTracker::bufferData(MemoryTracker::MARKER, bufferIDs[INDEX_BUFFER],
+                              numtri*sizeof(unsigned int[3]));
+
+    // initial shader load, waiting for it
+    shaderParts[0].type = GL_VERTEX_SHADER;
     shaderParts[0].file = "marker.vert";
-    shaderParts[1].id = glCreateShader(GL_FRAGMENT_SHADER);
+    shaderParts[0].defines = 0;
+    shaderParts[1].type = GL_FRAGMENT_SHADER;
     shaderParts[1].file = "marker.frag";
-    shaderID = glCreateProgram();
-    updateShaders();
+    shaderParts[1].defines = 0;
+    shaderID = loadShaders(sizeof(shaderParts)/sizeof(*shaderParts),
+                           shaderParts);
+    bindProgram();
 }
 
 //
@@ -70,18 +76,46 @@ Marker::Marker()
 //
 Marker::~Marker()
 {
-    glDeleteProgram(shaderID);
-    glDeleteBuffers(NUM_BUFFERS, bufferIDs);
+    cancelShaders(shaderBuild);
+    GLState::deleteProgram(shaderID);
+    GLState::deleteBuffers(NUM_BUFFERS, bufferIDs);
+    MemoryTracker::deleteBuffers(NUM_BUFFERS, bufferIDs);
 }
 
 //
-// load (or replace) terrain shaders
+// start loading replacement shaders
+// the current program stays in use until the new one links
 //
 void Marker::updateShaders()
 {
-    loadShaders(shaderID, sizeof(shaderParts)/sizeof(*shaderParts), 
-                shaderParts);
-    glUseProgram(shaderID);
+    startShaders(shaderBuild, sizeof(shaderParts)/sizeof(*shaderParts),
+                 shaderParts);
+}
+
+//
+// swap in reloaded shaders if they are ready
+//
+bool Marker::pollShaders()
+{
+    unsigned int newID;
+    if (::pollShaders(shaderBuild, false, newID) != SHADER_READY)
+        return false;
+
+    GLState::deleteProgram(shaderID);
+    shaderID = newID;
+    bindProgram();
+    Metrics::shaderReloads.add();
+    return true;
+}
+
+//
+// (re)connect shader parameters to current program
+//
+void Marker::bindProgram()
+{
+    if (! shaderID)
+        return;                 // initial load failed
+    GLState::useProgram(shaderID);
 
     // (re)connect uniform shader parameter blocks
     glUniformBlockBinding(shaderID, 
@@ -93,17 +127,12 @@ void Marker::updateShaders()
                           AppContext::MODEL_UNIFORMS);
 
     // re-connect attribute arrays
-    glBindVertexArray(varrayIDs[TERRAIN_VARRAY]);
+    GLState::bindVertexArray(varrayIDs[TERRAIN_VARRAY]);
 
     GLint positionAttrib = glGetAttribLocation(shaderID, "vPosition");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
     glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(positionAttrib);
-
-    // turn off everything we enabled
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
 }
 
 //
@@ -116,26 +145,23 @@ void Marker::updatePosition(const Vec3f &center)
 //
 // this is called every time the terrain needs to be redrawn 
 //
-void Marker::draw() const
+void Marker::draw(UniformRing &uniforms) const
 {
+    CpuProfiler::Zone zone("Marker::draw");
+
     // enable shaders
-    glUseProgram(shaderID);
+    GLState::useProgram(shaderID);
 
     // update uniform model-parameter block
-    glBindBuffer(GL_UNIFORM_BUFFER, bufferIDs[UNIFORM_BUFFER]);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ModelData), &mdata);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    uniforms.bind(AppContext::MODEL_UNIFORMS, &mdata, sizeof(ModelData));
 
     // enable vertex arrays
-    glBindVertexArray(varrayIDs[TERRAIN_VARRAY]);
+    GLState::bindVertexArray(varrayIDs[TERRAIN_VARRAY]);
 
     // draw the triangles for each three indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
     glDrawElements(GL_TRIANGLES, 3*numtri, GL_UNSIGNED_INT, 0);
-
-    // turn of whatever we turned on
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
+    Metrics::drawCalls.add();
+    Metrics::triangles.add(numtri);
 }
 
@@ -21,12 +21,18 @@ private:
     unsigned int varrayIDs[NUM_VARRAYS];
 
     // GL buffer object IDs
-    enum {POSITION_BUFFER, INDEX_BUFFER, UNIFORM_BUFFER, NUM_BUFFERS};
+    enum {POSITION_BUFFER, INDEX_BUFFER, NUM_BUFFERS};
     unsigned int bufferIDs[NUM_BUFFERS];
 
     // GL shaders
     unsigned int shaderID;      // ID for shader program
     ShaderInfo shaderParts[2];  // vertex & fragment shader info
+    ShaderBuild shaderBuild;    // replacement program being built
+
+// private methods
+private:
+    // connect uniforms and attribute arrays to new program
+    void bindProgram();
 
 // public data
 public:
@@ -42,14 +48,21 @@ public:
     // clean up allocated memory
     ~Marker();
 
-    // load/reload shaders
+    // start loading/reloading shaders in the background
     void updateShaders();
 
+    // switch to reloaded shaders once they are ready
+    // return true if the program changed
+    bool pollShaders();
+
     // update model matrix with new position
     void updatePosition(const Vec3f &center);
 
-    // draw this tetrahedron object
-    void draw() const;
+    // draw this tetrahedron object, with model data from uniforms ring
+    void draw(class UniformRing &uniforms) const;
+
+    // triangles drawn per frame
+    unsigned int triangles() const { return numtri; }
 };
 
 #endif
@@ -45,18 +45,4 @@ Mat4f zrotate4f(float angle) {
                         0, 0, 0, 1);
 }
 
-// build 4x4 scale matrix
-Mat4f scale4f(Vec3f s) {
-    return mat4<float>(s.x, 0, 0, 0,
-                       0, s.y, 0, 0,
-                       0, 0, s.z, 0,
-                       0, 0, 0, 1);
-}
-
-// build 4x4 translation matrix
-Mat4f translate4f(Vec3f t) {
-    return mat4<float>(1, 0, 0, 0,
-                       0, 1, 0, 0,
-                       0, 0, 1, 0,
-                       t.x, t.y, t.z, 1);
-}
+// scale4f and translate4f are constexpr, in Mat.inl
@@ -7,6 +7,7 @@
 
 #include "Mat.hpp"
 #include "Vec.inl"
+#include <limits>
 
 //////////////////////////////////////////////////////////////////////
 // matrix size
@@ -21,55 +22,52 @@ inline int dimensions(const Mat<T,N> &m) {
 // guarantees the type will be exactly equivalent to an array in
 // memory.
 
+// these, and the other builders with no trig, are constexpr so
+// fixed matrices can be built at compile time
+
 // build small sizes from list of vectors
 template <typename T>
-Mat<T,2> mat2(Vec<T,2> a0, Vec<T,2> a1) {
-    Mat<T,2> result;
-    result[0] = a0;
-    result[1] = a1;
-    return result;
+constexpr Mat<T,2> mat2(Vec<T,2> a0, Vec<T,2> a1) {
+    return Mat<T,2>{{{a0.data[0], a0.data[1]},
+                     {a1.data[0], a1.data[1]}}};
 }
 
 template <typename T>
-Mat<T,3> mat3(Vec<T,3> a0, Vec<T,3> a1, Vec<T,3> a2) {
-    Mat<T,3> result;
-    result[0] = a0;
-    result[1] = a1;
-    result[2] = a2;
-    return result;
+constexpr Mat<T,3> mat3(Vec<T,3> a0, Vec<T,3> a1, Vec<T,3> a2) {
+    return Mat<T,3>{{{a0.data[0], a0.data[1], a0.data[2]},
+                     {a1.data[0], a1.data[1], a1.data[2]},
+                     {a2.data[0], a2.data[1], a2.data[2]}}};
 }
 
 template <typename T>
-Mat<T,4> mat4(Vec<T,4> a0, Vec<T,4> a1, Vec<T,4> a2, Vec<T,4> a3) {
-    Mat<T,4> result;
-    result[0] = a0;
-    result[1] = a1;
-    result[2] = a2;
-    result[3] = a3;
-    return result;
+constexpr Mat<T,4> mat4(Vec<T,4> a0, Vec<T,4> a1, Vec<T,4> a2, Vec<T,4> a3) {
+    return Mat<T,4>{{{a0.data[0], a0.data[1], a0.data[2], a0.data[3]},
+                     {a1.data[0], a1.data[1], a1.data[2], a1.data[3]},
+                     {a2.data[0], a2.data[1], a2.data[2], a2.data[3]},
+                     {a3.data[0], a3.data[1], a3.data[2], a3.data[3]}}};
 }
 
 // build small sizes from list of numbers
 template <typename T>
-Mat<T,2> mat2(T a00, T a01,
-              T a10, T a11) {
+constexpr Mat<T,2> mat2(T a00, T a01,
+                        T a10, T a11) {
     return mat2<T>(vec2<T>(a00,a01), vec2<T>(a10,a11));
 }
 
 template <typename T>
-Mat<T,3> mat3(T a00, T a01, T a02,
-              T a10, T a11, T a12,
-              T a20, T a21, T a22) {
+constexpr Mat<T,3> mat3(T a00, T a01, T a02,
+                        T a10, T a11, T a12,
+                        T a20, T a21, T a22) {
     return mat3<T>(vec3<T>(a00, a01, a02),
                    vec3<T>(a10, a11, a12),
-                   vec3<T>(a20, a21, a22));;
+                   vec3<T>(a20, a21, a22));
 }
 
 template <typename T>
-Mat<T,4> mat4(T a00, T a01, T a02, T a03,
-              T a10, T a11, T a12, T a13,
-              T a20, T a21, T a22, T a23,
-              T a30, T a31, T a32, T a33) {
+constexpr Mat<T,4> mat4(T a00, T a01, T a02, T a03,
+                        T a10, T a11, T a12, T a13,
+                        T a20, T a21, T a22, T a23,
+                        T a30, T a31, T a32, T a33) {
     return mat4<T>(vec4<T>(a00,a01,a02,a03),
                    vec4<T>(a10,a11,a12,a13),
                    vec4<T>(a20,a21,a22,a23),
@@ -86,10 +84,20 @@ Mat4f yrotate4f(float angle);
 Mat4f zrotate4f(float angle);
 
 // build 4x4 scale matrix
-Mat4f scale4f(Vec3f s);
+constexpr Mat4f scale4f(Vec3f s) {
+    return mat4<float>(s.data[0], 0, 0, 0,
+                       0, s.data[1], 0, 0,
+                       0, 0, s.data[2], 0,
+                       0, 0, 0, 1);
+}
 
 // build 4x4 translation matrix
-Mat4f translate4f(Vec3f t);
+constexpr Mat4f translate4f(Vec3f t) {
+    return mat4<float>(1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0,
+                       t.data[0], t.data[1], t.data[2], 1);
+}
 
 //////////////////////////////////////////////////////////////////////
 // matrix addition and subtraction
@@ -142,15 +150,17 @@ inline Mat<T,N> operator/(const Mat<T,N> &m, T s) {
 
 //////////////////////////////////////////////////////////////////////
 // matrix*matrix, matrix*vector, and vector*matrix
+// these index data directly rather than through operator[], to avoid
+// copying a Vec for every element access
 template <typename T, int N>
 inline Mat<T,N> operator*(const Mat<T,N> &m1, const Mat<T,N> &m2) {
     Mat<T,N> result;
     for(int i=0; i<N; ++i) {
         for(int j=0; j<N; ++j) {
-            result[j][i] = m1[0][i] * m2[j][0];
+            result.data[j][i] = m1.data[0][i] * m2.data[j][0];
 
             for(int k=1; k<N; ++k)
-                result[j][i] += m1[k][i] * m2[j][k];
+                result.data[j][i] += m1.data[k][i] * m2.data[j][k];
         }
     }
     return result;
@@ -160,10 +170,10 @@ template <typename T, int N>
 inline Vec<T,N> operator*(const Vec<T,N> &v, const Mat<T,N> &m) {
   Vec<T,N> result;
   for(int i=0; i<N; ++i) {
-    result[i] = v[0] * m[i][0];
+    result.data[i] = v.data[0] * m.data[i][0];
 
     for(int j=1; j<N; ++j)
-      result[i] += v[j] * m[i][j];
+      result.data[i] += v.data[j] * m.data[i][j];
   }
   return result;
 }
@@ -172,10 +182,10 @@ template <typename T, int N>
 inline Vec<T,N> operator*(const Mat<T,N> &m, const Vec<T,N> &v) {
   Vec<T,N> result;
   for(int j=0; j<N; ++j) {
-    result[j] = m[0][j] * v[0];
+    result.data[j] = m.data[0][j] * v.data[0];
 
     for(int i=1; i<N; ++i)
-      result[j] += m[i][j] * v[i];
+      result.data[j] += m.data[i][j] * v.data[i];
   }
   return result;
 }
@@ -187,8 +197,216 @@ Mat<T,N> transpose(const Mat<T,N> &m) {
     Mat<T,N> result;
     for(int i=0; i<N; ++i)
         for(int j=0; j<N; ++j)
-            result[i][j] = m[j][i];
+            result.data[i][j] = m.data[j][i];
     return result;
 }
 
+// 1-norm: largest sum of absolute values in any column
+template <typename T, int N>
+inline T norm1(const Mat<T,N> &m) {
+    T result = 0;
+    for(int i=0; i<N; ++i) {
+        T sum = 0;
+        for(int j=0; j<N; ++j)
+            sum += fabs(m.data[i][j]);
+        if (sum > result) result = sum;
+    }
+    return result;
+}
+
+// general inverse by Gauss-Jordan elimination with pivoting
+// column operations reduce m to identity while turning identity into
+// the inverse. Return false, with result set to NaN, if m is singular
+// or has a NaN entry
+template <typename T, int N>
+bool inverse(const Mat<T,N> &m, Mat<T,N> &result) {
+    Mat<T,N> a = m;
+    for(int i=0; i<N; ++i)
+        for(int j=0; j<N; ++j)
+            result.data[i][j] = T(i==j);
+    T tiny = std::numeric_limits<T>::epsilon() * norm1(m);
+
+    for(int k=0; k<N; ++k) {
+        // pivot on the column with the largest entry in row k
+        int p = k;
+        for(int j=k+1; j<N; ++j)
+            if (fabs(a.data[j][k]) > fabs(a.data[p][k])) p = j;
+        if (! (fabs(a.data[p][k]) > tiny)) {
+            for(int i=0; i<N; ++i)
+                for(int j=0; j<N; ++j)
+                    result.data[i][j] = T(NAN);
+            return false;
+        }
+        for(int i=0; i<N; ++i) {
+            T t = a.data[k][i]; a.data[k][i] = a.data[p][i]; a.data[p][i] = t;
+            t = result.data[k][i];
+            result.data[k][i] = result.data[p][i];
+            result.data[p][i] = t;
+        }
+
+        // scale pivot column to put 1 on the diagonal
+        T s = 1 / a.data[k][k];
+        for(int i=0; i<N; ++i) {
+            a.data[k][i] *= s;
+            result.data[k][i] *= s;
+        }
+
+        // clear row k in every other column
+        for(int j=0; j<N; ++j) {
+            if (j == k) continue;
+            T f = a.data[j][k];
+            for(int i=0; i<N; ++i) {
+                a.data[j][i] -= f * a.data[k][i];
+                result.data[j][i] -= f * result.data[k][i];
+            }
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SSE (and AVX, if compiled for it) versions of the common 4x4 float
+// operations. Mat4f and Vec4f stay plain float arrays, so these use
+// unaligned loads and stores. Define MAT_NO_SIMD to use the generic
+// loops above instead, e.g. on other processors.
+#if !defined(MAT_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define MAT_SSE 1
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// result = m1 * m2 for column-major float[16], result may not alias
+inline void mul4f(const float *m1, const float *m2, float *result) {
+    __m128 c0 = _mm_loadu_ps(m1),   c1 = _mm_loadu_ps(m1+4);
+    __m128 c2 = _mm_loadu_ps(m1+8), c3 = _mm_loadu_ps(m1+12);
+#ifdef __AVX__
+    // two result columns at a time: each is m1 columns weighted by
+    // the corresponding m2 column
+    __m256 a0 = _mm256_set_m128(c0, c0), a1 = _mm256_set_m128(c1, c1);
+    __m256 a2 = _mm256_set_m128(c2, c2), a3 = _mm256_set_m128(c3, c3);
+    for(int j=0; j<16; j+=8) {
+        const float *b = m2 + j;
+        __m256 r = _mm256_mul_ps(a0, _mm256_set_m128(_mm_set1_ps(b[4]),
+                                                      _mm_set1_ps(b[0])));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_set_m128(
+                              _mm_set1_ps(b[5]), _mm_set1_ps(b[1]))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_set_m128(
+                              _mm_set1_ps(b[6]), _mm_set1_ps(b[2]))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_set_m128(
+                              _mm_set1_ps(b[7]), _mm_set1_ps(b[3]))));
+        _mm256_storeu_ps(result + j, r);
+    }
+#else
+    // each result column is m1 columns weighted by the m2 column
+    for(int j=0; j<16; j+=4) {
+        const float *b = m2 + j;
+        __m128 r = _mm_mul_ps(c0, _mm_set1_ps(b[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(b[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(b[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(b[3])));
+        _mm_storeu_ps(result + j, r);
+    }
+#endif
+}
+
+template <>
+inline Mat<float,4> operator*(const Mat<float,4> &m1, const Mat<float,4> &m2) {
+    Mat<float,4> result;
+    mul4f(&m1.data[0][0], &m2.data[0][0], &result.data[0][0]);
+    return result;
+}
+
+template <>
+inline Vec<float,4> operator*(const Mat<float,4> &m, const Vec<float,4> &v) {
+    // sum of matrix columns weighted by vector components
+    const float *c = &m.data[0][0];
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(c), _mm_set1_ps(v.data[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(c+4), _mm_set1_ps(v.data[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(c+8), _mm_set1_ps(v.data[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(c+12),_mm_set1_ps(v.data[3])));
+    Vec<float,4> result;
+    _mm_storeu_ps(result.data, r);
+    return result;
+}
+
+template <>
+inline Vec<float,4> operator*(const Vec<float,4> &v, const Mat<float,4> &m) {
+    // dot product of vector with each column: multiply, then transpose
+    // so the products for each column can be summed in parallel
+    const float *c = &m.data[0][0];
+    __m128 vv = _mm_loadu_ps(v.data);
+    __m128 p0 = _mm_mul_ps(_mm_loadu_ps(c), vv);
+    __m128 p1 = _mm_mul_ps(_mm_loadu_ps(c+4), vv);
+    __m128 p2 = _mm_mul_ps(_mm_loadu_ps(c+8), vv);
+    __m128 p3 = _mm_mul_ps(_mm_loadu_ps(c+12), vv);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    Vec<float,4> result;
+    _mm_storeu_ps(result.data,
+                  _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+    return result;
+}
+
+template <>
+inline Mat<float,4> transpose(const Mat<float,4> &m) {
+    const float *c = &m.data[0][0];
+    __m128 c0 = _mm_loadu_ps(c),   c1 = _mm_loadu_ps(c+4);
+    __m128 c2 = _mm_loadu_ps(c+8), c3 = _mm_loadu_ps(c+12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    Mat<float,4> result;
+    float *r = &result.data[0][0];
+    _mm_storeu_ps(r, c0);   _mm_storeu_ps(r+4, c1);
+    _mm_storeu_ps(r+8, c2); _mm_storeu_ps(r+12, c3);
+    return result;
+}
+
+template <>
+inline bool inverse(const Mat<float,4> &m, Mat<float,4> &result) {
+    // same elimination as the generic version, a column at a time
+    __m128 a[4], r[4];
+    for(int i=0; i<4; ++i) {
+        a[i] = _mm_loadu_ps(m.data[i]);
+        r[i] = _mm_setr_ps(i==0, i==1, i==2, i==3);
+    }
+    float tiny = std::numeric_limits<float>::epsilon() * norm1(m);
+
+    for(int k=0; k<4; ++k) {
+        // pivot on the column with the largest entry in row k
+        float row[4][4];
+        for(int j=0; j<4; ++j)
+            _mm_storeu_ps(row[j], a[j]);
+        int p = k;
+        for(int j=k+1; j<4; ++j)
+            if (fabsf(row[j][k]) > fabsf(row[p][k])) p = j;
+        if (! (fabsf(row[p][k]) > tiny)) {
+            __m128 nan = _mm_set1_ps(NAN);
+            for(int i=0; i<4; ++i)
+                _mm_storeu_ps(result.data[i], nan);
+            return false;
+        }
+        __m128 t = a[k]; a[k] = a[p]; a[p] = t;
+        t = r[k]; r[k] = r[p]; r[p] = t;
+        float f[4] = {row[0][k], row[1][k], row[2][k], row[3][k]};
+        float ft = f[k]; f[k] = f[p]; f[p] = ft;
+
+        // scale pivot column to put 1 on the diagonal
+        __m128 s = _mm_set1_ps(1 / f[k]);
+        a[k] = _mm_mul_ps(a[k], s);
+        r[k] = _mm_mul_ps(r[k], s);
+
+        // clear row k in every other column
+        for(int j=0; j<4; ++j) {
+            if (j == k) continue;
+            __m128 fj = _mm_set1_ps(f[j]);
+            a[j] = _mm_sub_ps(a[j], _mm_mul_ps(fj, a[k]));
+            r[j] = _mm_sub_ps(r[j], _mm_mul_ps(fj, r[k]));
+        }
+    }
+    for(int i=0; i<4; ++i)
+        _mm_storeu_ps(result.data[i], r[i]);
+    return true;
+}
+#endif
+
 #endif
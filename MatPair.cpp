@@ -29,6 +29,95 @@ MatPair4f perspective4fp(float fov, float aspect, float near, float far) {
     return result;
 }
 
+// inverse of affine m = [A | t]: [inverse(A) | -inverse(A)*t]
+// inverse(A) rows are cross products of the columns of A over its
+// determinant. Return false if A is singular
+static bool affineInverse(const Mat4f &m, Mat4f &result) {
+#ifdef MAT_SSE
+    // cross products with shuffles: (a.yzx * b.zxy - a.zxy * b.yzx)
+    #define YZX(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,0,2,1))
+    #define ZXY(v) _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,1,0,2))
+    #define CROSS(a,b) _mm_sub_ps(_mm_mul_ps(YZX(a), ZXY(b)), \
+                                  _mm_mul_ps(ZXY(a), YZX(b)))
+    __m128 c0 = _mm_loadu_ps(m.data[0]), c1 = _mm_loadu_ps(m.data[1]);
+    __m128 c2 = _mm_loadu_ps(m.data[2]);
+    __m128 r0 = CROSS(c1, c2), r1 = CROSS(c2, c0), r2 = CROSS(c0, c1);
+    #undef CROSS
+    #undef ZXY
+    #undef YZX
+
+    float det0[4];
+    _mm_storeu_ps(det0, _mm_mul_ps(c0, r0));
+    float det = det0[0] + det0[1] + det0[2];
+    if (det == 0) return false;
+    __m128 s = _mm_set1_ps(1/det);
+    r0 = _mm_mul_ps(r0, s);
+    r1 = _mm_mul_ps(r1, s);
+    r2 = _mm_mul_ps(r2, s);
+
+    // rows of the inverse, with translation in w, transposed to columns
+    float row[3][4];
+    _mm_storeu_ps(row[0], r0);
+    _mm_storeu_ps(row[1], r1);
+    _mm_storeu_ps(row[2], r2);
+    for(int i=0; i<3; ++i)
+        row[i][3] = -(row[i][0]*m.data[3][0] + row[i][1]*m.data[3][1]
+                      + row[i][2]*m.data[3][2]);
+    r0 = _mm_loadu_ps(row[0]);
+    r1 = _mm_loadu_ps(row[1]);
+    r2 = _mm_loadu_ps(row[2]);
+    __m128 r3 = _mm_setr_ps(0, 0, 0, 1);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(result.data[0], r0);
+    _mm_storeu_ps(result.data[1], r1);
+    _mm_storeu_ps(result.data[2], r2);
+    _mm_storeu_ps(result.data[3], r3);
+#else
+    Vec3f c0 = m[0].xyz, c1 = m[1].xyz, c2 = m[2].xyz, t = m[3].xyz;
+    Vec3f row[3] = {c1 ^ c2, c2 ^ c0, c0 ^ c1};
+    float det = dot(c0, row[0]);
+    if (det == 0) return false;
+    for(int i=0; i<3; ++i)
+        row[i] = row[i] / det;
+    for(int i=0; i<3; ++i)
+        result[i] = vec4<float>(row[0][i], row[1][i], row[2][i], 0);
+    result[3] = vec4<float>(-dot(row[0], t), -dot(row[1], t),
+                            -dot(row[2], t), 1);
+#endif
+    return true;
+}
+
+// build from any invertible matrix
+bool matpair4fp(const Mat4f &m, MatPair4f &result, float *condition) {
+    result.matrix = m;
+
+    // every entry must be finite
+    bool ok = true;
+    for(int i=0; i<4; ++i)
+        for(int j=0; j<4; ++j)
+            ok = ok && isfinite(m.data[i][j]);
+
+    // affine if last row is 0 0 0 1
+    if (ok) {
+        if (m.data[0][3] == 0 && m.data[1][3] == 0 && m.data[2][3] == 0
+            && m.data[3][3] == 1)
+            ok = affineInverse(m, result.inverse);
+        else
+            ok = inverse(m, result.inverse);
+    }
+
+    // condition number in the 1-norm. Also rejects matrices too close
+    // to singular for a useful float inverse
+    float cond = ok ? norm1(m) * norm1(result.inverse) : INFINITY;
+    if (! (cond < 1/std::numeric_limits<float>::epsilon())) {
+        for(int i=0; i<4; ++i)
+            result.inverse[i] = vec4<float>(NAN, NAN, NAN, NAN);
+        ok = false;
+    }
+    if (condition) *condition = ok ? cond : INFINITY;
+    return ok;
+}
+
 // build x, y, or z axis rotation for angle (in radians)
 MatPair4f xrotate4fp(float angle) {
     MatPair4f result;
@@ -49,26 +138,4 @@ MatPair4f zrotate4fp(float angle) {
     return result;
 }
 
-// build 4x4 scale matrix
-MatPair4f scale4fp(Vec3f s) {
-    MatPair4f result;
-    result.matrix = scale4f(s);
-    result.inverse = mat4<float>(
-        1/s.x, 0, 0, 0,
-        0, 1/s.y, 0, 0,
-        0, 0, 1/s.z, 0,
-        0, 0, 0, 1);
-    return result;
-}
-
-// build 4x4 translation matrix
-MatPair4f translate4fp(Vec3f t) {
-    MatPair4f result;
-    result.matrix = translate4f(t);
-    result.inverse = mat4<float>(
-        1, 0, 0, 0,
-        0, 1, 0, 0,
-        0, 0, 1, 0,
-        -t.x, -t.y, -t.z, 1);
-    return result;
-}
+// scale4fp and translate4fp are constexpr, in MatPair.inl
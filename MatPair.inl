@@ -16,18 +16,22 @@ inline int dimensions(const MatPair<T,N> &p) {
 
 //////////////////////////////////////////////////////////////////////
 // addition and subtraction
+// the inverse of a sum has to be computed from scratch, and is all NaN
+// if the sum is singular
 template <typename T, int N>
 inline MatPair<T,N> operator+(const MatPair<T,N> &m1, const MatPair<T,N> &m2) {
     MatPair<T,N> result;
     result.matrix = m1.matrix + m2.matrix;
-    result.inverse = m1.inverse + m2.inverse;
+    inverse(result.matrix, result.inverse);
+    return result;
 }
 
 template <typename T, int N>
 inline MatPair<T,N> operator-(const MatPair<T,N> &m1, const MatPair<T,N> &m2) {
     MatPair<T,N> result;
     result.matrix = m1.matrix - m2.matrix;
-    result.inverse = m1.inverse - m2.inverse;
+    inverse(result.matrix, result.inverse);
+    return result;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -66,6 +70,20 @@ inline MatPair<T,N> operator*(const MatPair<T,N> &m1, const MatPair<T,N> &m2) {
     return result;
 }
 
+#ifdef MAT_SSE
+// 4x4 float version: both products straight into the result
+template <>
+inline MatPair<float,4> operator*(const MatPair<float,4> &m1,
+                                  const MatPair<float,4> &m2) {
+    MatPair<float,4> result;
+    mul4f(&m1.matrix.data[0][0], &m2.matrix.data[0][0],
+          &result.matrix.data[0][0]);
+    mul4f(&m2.inverse.data[0][0], &m1.inverse.data[0][0],
+          &result.inverse.data[0][0]);
+    return result;
+}
+#endif
+
 
 //////////////////////////////////////////////////////////////////////
 // Build functions. Not done as constructors, so the matrix will be a
@@ -80,15 +98,31 @@ inline MatPair<T,N> operator*(const MatPair<T,N> &m1, const MatPair<T,N> &m2) {
 // x/y aspect ratio, and near/far clipping planes
 MatPair4f perspective4fp(float fov, float aspect, float near, float far);
 
+// build from any invertible matrix, computing its inverse
+// affine matrices (last row 0 0 0 1) use a faster 3x3 inverse
+// if condition is not 0, it is set to an estimate of the condition
+// number: the inverse loses about log10(condition) digits of accuracy
+// return false, leaving an all-NaN inverse, if m is singular, nearly
+// singular, or has non-finite entries
+bool matpair4fp(const Mat4f &m, MatPair4f &result, float *condition = 0);
+
 // build x, y, or z axis rotation for angle (in radians)
 MatPair4f xrotate4fp(float angle);
 MatPair4f yrotate4fp(float angle);
 MatPair4f zrotate4fp(float angle);
 
 // build 4x4 scale matrix
-MatPair4f scale4fp(Vec3f s);
+constexpr MatPair4f scale4fp(Vec3f s) {
+    return MatPair4f{scale4f(s),
+                     scale4f(vec3<float>(1/s.data[0], 1/s.data[1],
+                                         1/s.data[2]))};
+}
 
 // build 4x4 translation matrix
-MatPair4f translate4fp(Vec3f t);
+constexpr MatPair4f translate4fp(Vec3f t) {
+    return MatPair4f{translate4f(t),
+                     translate4f(vec3<float>(-t.data[0], -t.data[1],
+                                             -t.data[2]))};
+}
 
 #endif
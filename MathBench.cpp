@@ -0,0 +1,250 @@
+// microbenchmarks for the math library: Vec, Mat, MatPair, Quat and
+// Vec3fArray. Times each operation for the sizes and types the viewer
+// uses, reporting nanoseconds per call. No OpenGL needed.
+//   mathbench [filter]  -- only run operations whose name contains filter
+
+#include "Vec3fArray.hpp"
+#include "Quat.inl"
+#include "MatPair.inl"
+#include "Vec.inl"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// inputs cycle through this many random values, so results aren't
+// constant-folded and the working set stays in L1
+const int INPUTS = 256;
+
+// time each operation for about this long
+const double SECONDS = 0.05;
+
+// only run operations matching this (from command line)
+static const char *filter = 0;
+
+// results are copied here so the compiler can't discard them
+static volatile unsigned char sink;
+
+template <typename T>
+static void consume(const T &value) {
+    unsigned char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    sink = sink + bytes[0];
+}
+
+//////////////////////////////////////////////////////////////////////
+// random inputs
+
+template <typename T>
+static T random(T lo, T hi) {
+    return lo + (hi - lo) * T(rand()) / T(RAND_MAX);
+}
+
+template <typename T, int N>
+static Vec<T,N> randomVec() {
+    Vec<T,N> v;
+    for(int i=0; i<N; ++i)
+        v.data[i] = random(T(-1), T(1));
+    return v;
+}
+
+template <typename T, int N>
+static Mat<T,N> randomMat() {
+    Mat<T,N> m;
+    for(int i=0; i<N; ++i)
+        for(int j=0; j<N; ++j)
+            m.data[i][j] = random(T(-1), T(1));
+    return m;
+}
+
+//////////////////////////////////////////////////////////////////////
+// run op(i) for i cycling through inputs, doubling the iteration count
+// until it takes long enough to time, then report time per call
+template <typename Op>
+static void bench(const char *name, Op op, int perCall = 1)
+{
+    if (filter && ! strstr(name, filter)) return;
+
+    typedef std::chrono::steady_clock Clock;
+    double seconds = 0;
+    long calls = INPUTS;
+    for(;;) {
+        Clock::time_point start = Clock::now();
+        for(long c=0; c<calls; ++c)
+            op(int(c % INPUTS));
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= SECONDS) break;
+        calls *= 2;
+    }
+    printf("%-32s %10.2f ns\n", name, 1e9 * seconds / calls / perCall);
+}
+
+//////////////////////////////////////////////////////////////////////
+// per-type operations
+
+template <typename T, int N>
+static void benchVec(const char *type)
+{
+    static Vec<T,N> a[INPUTS], b[INPUTS];
+    for(int i=0; i<INPUTS; ++i) {
+        a[i] = randomVec<T,N>();
+        b[i] = randomVec<T,N>();
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s + %s", type, type);
+    bench(name, [](int i) { consume(a[i] + b[i]); });
+    snprintf(name, sizeof(name), "%s * scalar", type);
+    bench(name, [](int i) { consume(a[i] * T(2)); });
+    snprintf(name, sizeof(name), "dot(%s)", type);
+    bench(name, [](int i) { consume(dot(a[i], b[i])); });
+    snprintf(name, sizeof(name), "normalize(%s)", type);
+    bench(name, [](int i) { consume(normalize(a[i])); });
+}
+
+template <typename T, int N>
+static void benchMat(const char *type, const char *vtype)
+{
+    static Mat<T,N> a[INPUTS], b[INPUTS];
+    static Vec<T,N> v[INPUTS];
+    for(int i=0; i<INPUTS; ++i) {
+        a[i] = randomMat<T,N>();
+        b[i] = randomMat<T,N>();
+        v[i] = randomVec<T,N>();
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s * %s", type, type);
+    bench(name, [](int i) { consume(a[i] * b[i]); });
+    snprintf(name, sizeof(name), "%s * %s", type, vtype);
+    bench(name, [](int i) { consume(a[i] * v[i]); });
+    snprintf(name, sizeof(name), "%s * %s", vtype, type);
+    bench(name, [](int i) { consume(v[i] * a[i]); });
+    snprintf(name, sizeof(name), "transpose(%s)", type);
+    bench(name, [](int i) { consume(transpose(a[i])); });
+    snprintf(name, sizeof(name), "inverse(%s)", type);
+    bench(name, [](int i) {
+        Mat<T,N> inv;
+        inverse(a[i], inv);
+        consume(inv);
+    });
+}
+
+//////////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+    if (argc > 1) filter = argv[1];
+    srand(634);
+
+    benchVec<float,2>("Vec2f");
+    benchVec<float,3>("Vec3f");
+    benchVec<float,4>("Vec4f");
+    benchVec<double,3>("Vec3d");
+    benchVec<double,4>("Vec4d");
+
+    static Vec2f p[INPUTS], q[INPUTS], r[INPUTS];
+    static Vec3f u[INPUTS], v[INPUTS];
+    static float angle[INPUTS];
+    static Quatf quats[INPUTS];
+    for(int i=0; i<INPUTS; ++i) {
+        p[i] = randomVec<float,2>();
+        q[i] = randomVec<float,2>();
+        r[i] = randomVec<float,2>();
+        u[i] = randomVec<float,3>();
+        v[i] = randomVec<float,3>();
+        angle[i] = random(-3.f, 3.f);
+        quats[i] = rotateq(u[i], angle[i]);
+    }
+    bench("Vec3f ^ Vec3f", [](int i) { consume(u[i] ^ v[i]); });
+    bench("area(Vec2f)", [](int i) { consume(area(p[i], q[i], r[i])); });
+
+    benchMat<float,2>("Mat2f", "Vec2f");
+    benchMat<float,3>("Mat3f", "Vec3f");
+    benchMat<float,4>("Mat4f", "Vec4f");
+    benchMat<double,4>("Mat4d", "Vec4d");
+
+    // builders
+    bench("xrotate4f", [](int i) { consume(xrotate4f(angle[i])); });
+    bench("translate4f", [](int i) { consume(translate4f(u[i])); });
+    bench("scale4f", [](int i) { consume(scale4f(u[i])); });
+    bench("perspective4fp", [](int i) {
+        consume(perspective4fp(angle[i], 1.5f, 0.1f, 100.f));
+    });
+    bench("xrotate4fp", [](int i) { consume(xrotate4fp(angle[i])); });
+    bench("translate4fp", [](int i) { consume(translate4fp(u[i])); });
+    bench("scale4fp", [](int i) { consume(scale4fp(u[i])); });
+    bench("rotateq", [](int i) { consume(rotateq(u[i], angle[i])); });
+    bench("rotate4fp(Quatf)", [](int i) { consume(rotate4fp(quats[i])); });
+
+    // MatPair composition and inversion
+    static MatPair4f pairs[INPUTS];
+    for(int i=0; i<INPUTS; ++i)
+        pairs[i] = xrotate4fp(angle[i]) * translate4fp(u[i]);
+    bench("MatPair4f * MatPair4f", [](int i) {
+        consume(pairs[i] * pairs[(i+1) % INPUTS]);
+    });
+    bench("MatPair4f + MatPair4f", [](int i) {
+        consume(pairs[i] + pairs[(i+1) % INPUTS]);
+    });
+    bench("matpair4fp(affine)", [](int i) {
+        MatPair4f result;
+        matpair4fp(pairs[i].matrix, result);
+        consume(result);
+    });
+    static Mat4f general[INPUTS];
+    for(int i=0; i<INPUTS; ++i)
+        general[i] = randomMat<float,4>();
+    bench("matpair4fp(general)", [](int i) {
+        MatPair4f result;
+        matpair4fp(general[i], result);
+        consume(result);
+    });
+
+    // quaternions
+    bench("Quatf * Quatf", [](int i) {
+        consume(quats[i] * quats[(i+1) % INPUTS]);
+    });
+    bench("slerp(Quatf)", [](int i) {
+        consume(slerp(quats[i], quats[(i+1) % INPUTS], 0.3f));
+    });
+
+    // view matrix: closed form, and the chain it replaced
+    bench("orbitview4fp", [](int i) {
+        consume(orbitview4fp(u[i], p[i], v[i]));
+    });
+    bench("orbit view MatPair chain", [](int i) {
+        consume(xrotate4fp(-3.1415926f/2)
+                * xrotate4fp(u[i].y) * zrotate4fp(u[i].x)
+                * yrotate4fp(p[i].x) * xrotate4fp(p[i].y)
+                * translate4fp(vec3<float>(0, 0, -u[i].z))
+                * translate4fp(-1.f * v[i]));
+    });
+
+    // bulk kernels, reported per vector
+    const unsigned int BULK = 4096;
+    static Vec3fArray a(BULK), b(BULK), result(BULK);
+    static float dots[BULK];
+    for(unsigned int i=0; i<BULK; ++i) {
+        a.set(i, randomVec<float,3>());
+        b.set(i, randomVec<float,3>());
+    }
+    bench("Vec3fArray cross", [](int) {
+        cross(a, b, result);
+        consume(result.x[0]);
+    }, BULK);
+    bench("Vec3fArray normalize", [](int) {
+        normalize(a, result);
+        consume(result.x[0]);
+    }, BULK);
+    bench("Vec3fArray dot", [](int) {
+        dot(a, b, dots);
+        consume(dots[0]);
+    }, BULK);
+    bench("Vec3fArray transformPoints", [](int i) {
+        transformPoints(pairs[i], a, result);
+        consume(result.x[0]);
+    }, BULK);
+
+    return 0;
+}
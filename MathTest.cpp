@@ -0,0 +1,335 @@
+// property tests for the math library: Vec, Mat, MatPair, Quat and
+// Vec3fArray. Checks algebraic identities on random inputs rather than
+// exact answers, so it doesn't depend on evaluation order or SIMD.
+// Also checks the metrics histogram buckets.
+// No OpenGL needed. Prints each failure, and exits non-zero if any.
+
+#include "Vec3fArray.hpp"
+#include "Metrics.hpp"
+#include "Quat.inl"
+#include "MatPair.inl"
+#include "Vec.inl"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef F_PI
+#define F_PI 3.1415926f
+#endif
+
+// random inputs per property
+const int TRIALS = 1000;
+
+// totals for report
+static int checks = 0, failures = 0;
+
+// compile-time builders really are constant
+static_assert(translate4fp(vec3<float>(1, 2, 3)).inverse.data[3][1] == -2,
+              "constexpr translate4fp");
+static_assert(rotate4fp(quat<float>(0, 0, 0, 1)).matrix.data[2][2] == 1,
+              "constexpr rotate4fp");
+
+//////////////////////////////////////////////////////////////////////
+// random values and helpers
+
+// uniform in [lo,hi]
+template <typename T>
+static T random(T lo, T hi) {
+    return lo + (hi - lo) * T(rand()) / T(RAND_MAX);
+}
+
+template <typename T, int N>
+static Vec<T,N> randomVec(T lo = -1, T hi = 1) {
+    Vec<T,N> v;
+    for(int i=0; i<N; ++i)
+        v.data[i] = random(lo, hi);
+    return v;
+}
+
+template <typename T, int N>
+static Mat<T,N> randomMat(T lo = -1, T hi = 1) {
+    Mat<T,N> m;
+    for(int i=0; i<N; ++i)
+        for(int j=0; j<N; ++j)
+            m.data[i][j] = random(lo, hi);
+    return m;
+}
+
+static Quatf randomQuat() {
+    return rotateq(randomVec<float,3>(), random(-F_PI, F_PI));
+}
+
+// largest difference between two matrices, relative to size of a
+template <typename T, int N>
+static T difference(const Mat<T,N> &a, const Mat<T,N> &b) {
+    T diff = 0;
+    for(int i=0; i<N; ++i)
+        for(int j=0; j<N; ++j)
+            diff = fmax(diff, fabs(a.data[i][j] - b.data[i][j]));
+    return diff / fmax(T(1), norm1(a));
+}
+
+template <typename T, int N>
+static Mat<T,N> identity() {
+    Mat<T,N> m;
+    for(int i=0; i<N; ++i)
+        for(int j=0; j<N; ++j)
+            m.data[i][j] = T(i==j);
+    return m;
+}
+
+// record one check, reporting the first failure of each property
+static bool check(bool ok, const char *property, double error)
+{
+    ++checks;
+    if (! ok) {
+        if (failures < 100)
+            fprintf(stderr, "FAIL %s (error %g)\n", property, error);
+        ++failures;
+    }
+    return ok;
+}
+
+// matrix and inverse multiply to identity both ways
+static void checkPair(const MatPair4f &p, float tolerance, const char *name)
+{
+    Mat4f I = identity<float,4>();
+    float e = fmax(difference(I, p.matrix * p.inverse),
+                   difference(I, p.inverse * p.matrix));
+    check(e <= tolerance, name, e);
+}
+
+//////////////////////////////////////////////////////////////////////
+// properties
+
+// products are associative, and transpose reverses them
+template <typename T, int N>
+static void testProducts(T tolerance, const char *assoc,
+                         const char *trans, const char *matvec)
+{
+    for(int t=0; t<TRIALS; ++t) {
+        Mat<T,N> a = randomMat<T,N>(), b = randomMat<T,N>();
+        Mat<T,N> c = randomMat<T,N>();
+        Vec<T,N> v = randomVec<T,N>();
+
+        T e = difference((a*b)*c, a*(b*c));
+        check(e <= tolerance, assoc, e);
+
+        e = difference(transpose(a*b), transpose(b)*transpose(a));
+        check(e <= tolerance, trans, e);
+
+        Vec<T,N> av = a*v, va = v*transpose(a);
+        e = 0;
+        for(int i=0; i<N; ++i)
+            e = fmax(e, fabs(av[i] - va[i]));
+        check(e <= tolerance, matvec, e);
+    }
+}
+
+// every MatPair builder keeps matrix * inverse = I
+static void testBuilders()
+{
+    for(int t=0; t<TRIALS; ++t) {
+        float a = random(-2*F_PI, 2*F_PI);
+        checkPair(xrotate4fp(a), 1e-6f, "xrotate4fp inverse");
+        checkPair(yrotate4fp(a), 1e-6f, "yrotate4fp inverse");
+        checkPair(zrotate4fp(a), 1e-6f, "zrotate4fp inverse");
+        checkPair(rotate4fp(randomQuat()), 1e-6f, "rotate4fp inverse");
+        checkPair(translate4fp(randomVec<float,3>(-100, 100)), 1e-6f,
+                  "translate4fp inverse");
+        checkPair(scale4fp(randomVec<float,3>(0.1f, 10)), 1e-6f,
+                  "scale4fp inverse");
+        checkPair(perspective4fp(random(0.1f, 3.f), random(0.5f, 2.f),
+                                 random(0.1f, 1.f), random(10.f, 1000.f)),
+                  1e-5f, "perspective4fp inverse");
+
+        // composition keeps the pair consistent
+        MatPair4f p = xrotate4fp(a) * translate4fp(randomVec<float,3>())
+            * scale4fp(randomVec<float,3>(0.5f, 2)) * rotate4fp(randomQuat());
+        checkPair(p, 1e-5f, "MatPair product inverse");
+
+        // inverse of arbitrary matrices, within the condition estimate
+        float cond;
+        Mat4f m = randomMat<float,4>();
+        MatPair4f g;
+        if (matpair4fp(m, g, &cond))
+            checkPair(g, 1e-6f * cond, "matpair4fp general inverse");
+
+        // affine fast path
+        if (check(matpair4fp(p.matrix, g, &cond), "matpair4fp affine", cond)) {
+            checkPair(g, 1e-5f, "matpair4fp affine inverse");
+            float e = difference(g.inverse, p.inverse);
+            check(e <= 1e-5f, "matpair4fp matches builder", e);
+        }
+
+        // sums get a fresh inverse
+        checkPair(xrotate4fp(a) + scale4fp(randomVec<float,3>(1, 2)), 1e-5f,
+                  "MatPair sum inverse");
+    }
+
+    // bad input is rejected
+    MatPair4f p;
+    float cond;
+    Mat4f zero = Mat4f();
+    check(! matpair4fp(zero, p, &cond), "matpair4fp rejects singular", cond);
+    Mat4f nan = identity<float,4>();
+    nan.data[1][1] = NAN;
+    check(! matpair4fp(nan, p, &cond), "matpair4fp rejects NaN", cond);
+}
+
+// vector identities
+static void testVectors()
+{
+    for(int t=0; t<TRIALS; ++t) {
+        Vec3f a = randomVec<float,3>(), b = randomVec<float,3>();
+
+        float e = fabs(length(normalize(a)) - 1);
+        check(e <= 1e-6f, "normalize length", e);
+
+        Vec3f c = a ^ b;
+        e = fmax(fabs(dot(c, a)), fabs(dot(c, b)));
+        check(e <= 1e-6f, "cross product orthogonal", e);
+
+        e = fabs(dot(a, b) - dot(b, a));
+        check(e == 0, "dot symmetric", e);
+
+        // area is half the cross product length in the plane
+        Vec2f p = a.xy, q = b.xy, r = randomVec<float,2>();
+        Vec3f pq = vec3<float>(q.x-p.x, q.y-p.y, 0);
+        Vec3f pr = vec3<float>(r.x-p.x, r.y-p.y, 0);
+        e = fabs(area(p, q, r) - 0.5f * length(pq ^ pr));
+        check(e <= 1e-6f, "area", e);
+    }
+}
+
+// quaternions agree with the matrices they build
+static void testQuaternions()
+{
+    for(int t=0; t<TRIALS; ++t) {
+        Quatf q1 = randomQuat(), q2 = randomQuat();
+        float e = difference(rotate4f(q1*q2), rotate4f(q1) * rotate4f(q2));
+        check(e <= 1e-6f, "quaternion product", e);
+
+        float a = random(-F_PI, F_PI);
+        e = difference(rotate4f(xrotateq(a)), xrotate4f(a));
+        check(e <= 1e-6f, "xrotateq", e);
+
+        // slerp ends at its inputs, up to sign
+        Quatf s0 = slerp(q1, q2, 0.f), s1 = slerp(q1, q2, 1.f);
+        e = fmax(difference(rotate4f(s0), rotate4f(q1)),
+                 difference(rotate4f(s1), rotate4f(q2)));
+        check(e <= 1e-5f, "slerp endpoints", e);
+
+        // and moves at constant angular speed
+        Quatf x0 = xrotateq(0), x1 = xrotateq(a);
+        e = difference(rotate4f(slerp(x0, x1, 0.25f)), xrotate4f(a/4));
+        check(e <= 1e-5f, "slerp angle", e);
+    }
+}
+
+// closed-form orbiting view matches the chain of MatPair products
+// Scene::buildView used to make
+static void testView()
+{
+    for(int t=0; t<TRIALS; ++t) {
+        Vec3f view = vec3<float>(random(-F_PI, F_PI), random(-F_PI/2, F_PI/2),
+                                 random(1.f, 500.f));
+        Vec2f alignment = randomVec<float,2>(-0.5f, 0.5f);
+        Vec3f position = randomVec<float,3>(-1000.f, 1000.f);
+
+        MatPair4f chain = xrotate4fp(-F_PI/2)
+            * xrotate4fp(view.y) * zrotate4fp(view.x)
+            * yrotate4fp(alignment.x) * xrotate4fp(alignment.y)
+            * translate4fp(vec3<float>(0, 0, -view.z))
+            * translate4fp(-1.f * position);
+        MatPair4f closed = orbitview4fp(view, alignment, position);
+
+        float e = fmax(difference(closed.matrix, chain.matrix),
+                       difference(closed.inverse, chain.inverse));
+        check(e <= 1e-5f, "orbitview4fp matches chain", e);
+
+        // float rounding in the translation grows with its size
+        checkPair(closed, 2e-6f * (1 + view.z + length(position)),
+                  "orbitview4fp inverse");
+    }
+}
+
+// bulk kernels match one-at-a-time results
+static void testArrays()
+{
+    const unsigned int SIZE = 37;       // not a multiple of the SIMD width
+    Vec3f a[SIZE], b[SIZE], r[SIZE];
+    for(unsigned int i=0; i<SIZE; ++i) {
+        a[i] = randomVec<float,3>();
+        b[i] = randomVec<float,3>();
+    }
+    Vec3fArray sa, sb, sr;
+    sa.load(a, SIZE);
+    sb.load(b, SIZE);
+    MatPair4f m = xrotate4fp(0.3f) * translate4fp(vec3<float>(1, 2, 3));
+
+    float e = 0;
+    cross(sa, sb, sr);
+    normalize(sr, sr);
+    sr.store(r);
+    for(unsigned int i=0; i<SIZE; ++i)
+        e = fmax(e, length(r[i] - normalize(a[i] ^ b[i])));
+    check(e == 0, "Vec3fArray cross and normalize", e);
+
+    e = 0;
+    transformPoints(m, sa, sr);
+    sr.store(r);
+    for(unsigned int i=0; i<SIZE; ++i) {
+        Vec4f p = m.matrix * vec4<float>(a[i].x, a[i].y, a[i].z, 1);
+        e = fmax(e, length(r[i] - p.xyz));
+    }
+    check(e <= 1e-6f, "Vec3fArray transformPoints", e);
+
+    float d[SIZE];
+    dot(sa, sb, d);
+    e = 0;
+    for(unsigned int i=0; i<SIZE; ++i)
+        e = fmax(e, fabs(d[i] - dot(a[i], b[i])));
+    check(e <= 1e-6f, "Vec3fArray dot", e);
+}
+
+//////////////////////////////////////////////////////////////////////
+// histogram bounds are inclusive, as Prometheus le labels are
+static void testHistogram()
+{
+    Metrics::Histogram h("test_seconds", "test", 1e-4);
+    unsigned int wrong = 0, first = 0;
+    for(unsigned int b=0; b<Metrics::Histogram::NUM_BUCKETS; ++b) {
+        double bound = h.bound(b);
+        if (h.bucket(bound) != b || h.bucket(bound*(1 + 1e-9)) != b+1) {
+            if (! wrong) first = b;
+            ++wrong;
+        }
+    }
+    check(wrong == 0, "histogram bound in its own bucket", first);
+    check(h.bucket(0) == 0, "histogram zero in first bucket", 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+int main()
+{
+    srand(634);
+
+    testProducts<float,2>(1e-6f, "Mat2f associative", "Mat2f transpose",
+                          "Mat2f*Vec2f");
+    testProducts<float,3>(1e-6f, "Mat3f associative", "Mat3f transpose",
+                          "Mat3f*Vec3f");
+    testProducts<float,4>(1e-6f, "Mat4f associative", "Mat4f transpose",
+                          "Mat4f*Vec4f");
+    testProducts<double,4>(1e-14, "Mat4d associative", "Mat4d transpose",
+                           "Mat4d*Vec4d");
+    testBuilders();
+    testVectors();
+    testQuaternions();
+    testView();
+    testArrays();
+    testHistogram();
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+// account for CPU and GPU memory by subsystem
+
+#include "MemoryTracker.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace {
+    const char *subsystemNames[MemoryTracker::NUM_SUBSYSTEMS] = {
+        "mesh", "textures", "images", "marker", "uniforms", "capture"
+    };
+
+    // where a GL object's bytes are counted
+    struct Object {
+        MemoryTracker::Subsystem subsystem;
+        size_t bytes;
+    };
+
+    // all counts, behind one lock
+    struct Accounts {
+        std::mutex lock;
+        size_t current[MemoryTracker::NUM_SUBSYSTEMS + 1]
+                      [MemoryTracker::NUM_KINDS];  // last is total
+        size_t peak[MemoryTracker::NUM_SUBSYSTEMS + 1]
+                   [MemoryTracker::NUM_KINDS];
+        std::map<unsigned int, Object> buffers, textures;
+    } accounts;
+
+    const unsigned int TOTAL = MemoryTracker::NUM_SUBSYSTEMS;
+
+    //
+    // add or remove bytes, with the lock held
+    //
+    void change(MemoryTracker::Subsystem subsystem, MemoryTracker::Kind kind,
+                size_t bytes, bool adding)
+    {
+        unsigned int rows[2] = {(unsigned int)subsystem, TOTAL};
+        for(unsigned int r=0; r<2; ++r) {
+            size_t &now = accounts.current[rows[r]][kind];
+            if (adding)
+                now += bytes;
+            else
+                now -= bytes < now ? bytes : now;
+            if (now > accounts.peak[rows[r]][kind])
+                accounts.peak[rows[r]][kind] = now;
+        }
+    }
+
+    //
+    // record a GL object's new size, replacing its old one
+    //
+    void resize(std::map<unsigned int, Object> &objects, unsigned int id,
+                MemoryTracker::Subsystem subsystem, size_t bytes)
+    {
+        std::map<unsigned int, Object>::iterator old = objects.find(id);
+        if (old != objects.end())
+            change(old->second.subsystem, MemoryTracker::GPU,
+                   old->second.bytes, false);
+        Object object = {subsystem, bytes};
+        objects[id] = object;
+        change(subsystem, MemoryTracker::GPU, bytes, true);
+    }
+
+    //
+    // forget deleted GL objects
+    //
+    void forget(std::map<unsigned int, Object> &objects, int n,
+                const unsigned int *ids)
+    {
+        for(int i=0; i<n; ++i) {
+            std::map<unsigned int, Object>::iterator old = objects.find(ids[i]);
+            if (old == objects.end()) continue;
+            change(old->second.subsystem, MemoryTracker::GPU,
+                   old->second.bytes, false);
+            objects.erase(old);
+        }
+    }
+}
+
+//
+// count CPU or GPU bytes
+//
+void MemoryTracker::add(Subsystem subsystem, Kind kind, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    change(subsystem, kind, bytes, true);
+}
+
+void MemoryTracker::remove(Subsystem subsystem, Kind kind, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    change(subsystem, kind, bytes, false);
+}
+
+//
+// buffer storage is the size asked for
+//
+void MemoryTracker::bufferData(Subsystem subsystem, unsigned int bufferID,
+                               size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    resize(accounts.buffers, bufferID, subsystem, bytes);
+}
+
+//
+// each mip level is half the size (rounded down, at least 1) of the
+// one before, down to 1x1. Drivers usually pad 3 byte texels to 4, so
+// callers should pass 4 for GL_RGB.
+//
+void MemoryTracker::textureImage(Subsystem subsystem, unsigned int textureID,
+                                 unsigned int width, unsigned int height,
+                                 unsigned int bytesPerTexel, bool mipmapped)
+{
+    size_t bytes = size_t(width) * height * bytesPerTexel;
+    while (mipmapped && (width > 1 || height > 1)) {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+        bytes += size_t(width) * height * bytesPerTexel;
+    }
+
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    resize(accounts.textures, textureID, subsystem, bytes);
+}
+
+//
+// objects that were never sized are skipped
+//
+void MemoryTracker::deleteBuffers(int n, const unsigned int *bufferIDs)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    forget(accounts.buffers, n, bufferIDs);
+}
+
+void MemoryTracker::deleteTextures(int n, const unsigned int *textureIDs)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    forget(accounts.textures, n, textureIDs);
+}
+
+//
+// one line per subsystem, in KB
+//
+void MemoryTracker::report(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    fprintf(out, "memory (KB)   CPU now   CPU peak   GPU now   GPU peak\n");
+    for(unsigned int s=0; s<=TOTAL; ++s)
+        fprintf(out, "  %-10s %9.0f %10.0f %9.0f %10.0f\n",
+                s == TOTAL ? "total" : subsystemNames[s],
+                accounts.current[s][CPU] / 1024., accounts.peak[s][CPU] / 1024.,
+                accounts.current[s][GPU] / 1024., accounts.peak[s][GPU] / 1024.);
+}
+
+//
+// {"mesh": {"cpu": bytes, "cpu_peak": ..., "gpu": ..., "gpu_peak": ...},
+//  ..., "total": {...}}
+//
+void MemoryTracker::writeJSON(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(accounts.lock);
+    fprintf(out, "{");
+    for(unsigned int s=0; s<=TOTAL; ++s)
+        fprintf(out, "%s\n    \"%s\": {\"cpu\": %llu, \"cpu_peak\": %llu, "
+                "\"gpu\": %llu, \"gpu_peak\": %llu}", s ? "," : "",
+                s == TOTAL ? "total" : subsystemNames[s],
+                (unsigned long long)accounts.current[s][CPU],
+                (unsigned long long)accounts.peak[s][CPU],
+                (unsigned long long)accounts.current[s][GPU],
+                (unsigned long long)accounts.peak[s][GPU]);
+    fprintf(out, "\n  }");
+}
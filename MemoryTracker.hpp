@@ -0,0 +1,70 @@
+// account for CPU and GPU memory by subsystem
+#ifndef MemoryTracker_hpp
+#define MemoryTracker_hpp
+
+#include <stddef.h>
+#include <stdio.h>
+
+// CPU arrays are made and freed through allocate and release, which
+// count their bytes against a subsystem. GPU memory can't be asked for
+// in core OpenGL, so every glBufferData (or glBufferStorage) and
+// glTexImage2D is followed by a call here recording an estimate of its
+// size by object name, replacing any earlier size for the same object,
+// and deleteBuffers/deleteTextures forget them again. Current and peak
+// bytes are kept for each subsystem, and for all of them together.
+// All static and locked, since images are decoded and meshes built on
+// worker threads.
+class MemoryTracker {
+// public constants
+public:
+    enum Subsystem {
+        MESH,                   // terrain arrays and vertex buffers
+        TEXTURES,               // terrain textures with mipmaps
+        IMAGES,                 // ImagePPM pixels
+        MARKER,                 // light marker buffers
+        UNIFORMS,               // per-frame uniform ring
+        CAPTURE,                // frame readback buffers
+        NUM_SUBSYSTEMS
+    };
+    enum Kind {CPU, GPU, NUM_KINDS};
+
+// public methods
+public:
+    // count bytes for subsystem
+    static void add(Subsystem subsystem, Kind kind, size_t bytes);
+    static void remove(Subsystem subsystem, Kind kind, size_t bytes);
+
+    // new[] and delete[] of count Ts, counted as CPU memory
+    template<typename T>
+    static T *allocate(Subsystem subsystem, size_t count) {
+        T *array = new T[count];
+        add(subsystem, CPU, count * sizeof(T));
+        return array;
+    }
+    template<typename T>
+    static void release(Subsystem subsystem, T *array, size_t count) {
+        if (! array) return;
+        delete[] array;
+        remove(subsystem, CPU, count * sizeof(T));
+    }
+
+    // record the size of a buffer object's storage
+    static void bufferData(Subsystem subsystem, unsigned int bufferID,
+                           size_t bytes);
+
+    // record the size of a texture from its base level, with the whole
+    // mipmap chain if it has one
+    static void textureImage(Subsystem subsystem, unsigned int textureID,
+                             unsigned int width, unsigned int height,
+                             unsigned int bytesPerTexel, bool mipmapped);
+
+    // forget deleted GL objects, alongside glDeleteBuffers/Textures
+    static void deleteBuffers(int n, const unsigned int *bufferIDs);
+    static void deleteTextures(int n, const unsigned int *textureIDs);
+
+    // current and peak bytes, as a table or a JSON object
+    static void report(FILE *out);
+    static void writeJSON(FILE *out);
+};
+
+#endif
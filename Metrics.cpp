@@ -0,0 +1,188 @@
+// counters, gauges and histograms for monitoring a running GLdemo
+
+#include "Metrics.hpp"
+
+#include <math.h>
+#include <string>
+
+namespace {
+    // all metrics, in the order they were made. Pointers are zero
+    // before any constructor runs, so metrics in any file can join.
+    Metrics::Metric *first = 0, *last = 0;
+}
+
+// defined in one place, so they are listed in this order
+Metrics::Counter Metrics::framesDrawn("gldemo_frames_total",
+    "Frames drawn");
+Metrics::Histogram Metrics::frameTime("gldemo_frame_seconds",
+    "Time from frame start until swapped, in seconds", 1e-4);
+Metrics::Gauge Metrics::pendingJobs("gldemo_pending_jobs",
+    "GL jobs waiting for room between frames");
+Metrics::Counter Metrics::drawCalls("gldemo_draw_calls_total",
+    "Draw calls issued");
+Metrics::Counter Metrics::triangles("gldemo_triangles_total",
+    "Triangles submitted in draw calls");
+Metrics::Counter Metrics::elevationQueries("gldemo_elevation_queries_total",
+    "Terrain elevation lookups");
+Metrics::Counter Metrics::shaderReloads("gldemo_shader_reloads_total",
+    "Shader programs replaced after an edit");
+Metrics::Counter Metrics::textureBytes("gldemo_texture_upload_bytes_total",
+    "Texture image bytes uploaded");
+Metrics::Counter Metrics::glCallsIssued("gldemo_gl_binds_issued_total",
+    "GL bind calls made");
+Metrics::Counter Metrics::glCallsElided("gldemo_gl_binds_elided_total",
+    "GL bind calls skipped as already bound");
+Metrics::Counter Metrics::viewBuilds("gldemo_view_builds_total",
+    "View matrices rebuilt");
+Metrics::Counter Metrics::inputEvents("gldemo_input_events_total",
+    "Key and mouse events handled");
+Metrics::Counter Metrics::simulationSteps("gldemo_simulation_steps_total",
+    "Fixed movement steps simulated");
+
+//
+// add to the end of the list
+//
+Metrics::Metric::Metric(const char *metricName, const char *metricHelp)
+    : next(0), name(metricName), help(metricHelp)
+{
+    if (last)
+        last->next = this;
+    else
+        first = this;
+    last = this;
+}
+
+//
+// value as a counter
+//
+void Metrics::Counter::write(FILE *out) const
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+            name, help, name, name,
+            value.load(std::memory_order_relaxed));
+}
+
+//
+// value as a gauge
+//
+void Metrics::Gauge::write(FILE *out) const
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %g\n",
+            name, help, name, name, value.load(std::memory_order_relaxed));
+}
+
+//
+// empty buckets
+//
+Metrics::Histogram::Histogram(const char *name, const char *help,
+                              double smallestValue)
+    : Metric(name, help), smallest(smallestValue), count(0), sum(0)
+{
+    for(unsigned int b=0; b<NUM_BUCKETS; ++b)
+        buckets[b] = 0;
+}
+
+//
+// largest value in bucket: smallest for bucket 0, then SUB_BUCKETS
+// equal steps up to each next power of two
+//
+double Metrics::Histogram::bound(unsigned int bucket) const
+{
+    if (bucket == 0) return smallest;
+    unsigned int octave = (bucket - 1) / SUB_BUCKETS;
+    unsigned int sub = (bucket - 1) % SUB_BUCKETS;
+    return ldexp(smallest * (1 + double(sub + 1) / SUB_BUCKETS), int(octave));
+}
+
+//
+// find bucket from the exponent and top mantissa bits
+//
+unsigned int Metrics::Histogram::bucket(double value) const
+{
+    if (value <= smallest) return 0;
+
+    // value/smallest = mantissa * 2^exponent, mantissa in [0.5,1).
+    // Rounding up puts a value on a bound in the bucket below it; an
+    // exact power of two (mantissa 0.5) gives sub = -1, the last
+    // bucket of the octave below.
+    int exponent;
+    double mantissa = frexp(value / smallest, &exponent);
+    int sub = int(ceil((2*mantissa - 1) * SUB_BUCKETS)) - 1;
+    int b = 1 + (exponent - 1) * SUB_BUCKETS + sub;
+    if (b >= NUM_BUCKETS) return NUM_BUCKETS;   // only in +Inf
+
+    // the division can round across a bound, so settle it with bound()
+    if (b > 1 && value <= bound(b - 1)) --b;
+    else if (value > bound(b)) ++b;
+    return (unsigned int)b;
+}
+
+//
+// count in bucket and running sum
+//
+void Metrics::Histogram::record(double value)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+    double old = sum.load(std::memory_order_relaxed);
+    while (! sum.compare_exchange_weak(old, old + value,
+                                       std::memory_order_relaxed))
+        ;
+
+    unsigned int b = bucket(value);
+    if (b < NUM_BUCKETS)
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+}
+
+//
+// cumulative buckets, as Prometheus expects
+//
+void Metrics::Histogram::write(FILE *out) const
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n",
+            name, help, name);
+    unsigned long long total = 0;
+    for(unsigned int b=0; b<NUM_BUCKETS; ++b) {
+        total += buckets[b].load(std::memory_order_relaxed);
+        fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", name, bound(b), total);
+    }
+
+    // count may have moved on since the buckets were read
+    unsigned long long n = count.load(std::memory_order_relaxed);
+    if (n < total) n = total;
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, n);
+    fprintf(out, "%s_sum %g\n%s_count %llu\n",
+            name, sum.load(std::memory_order_relaxed), name, n);
+}
+
+//
+// each metric in turn
+//
+void Metrics::write(FILE *out)
+{
+    for(const Metric *m = first; m; m = m->next)
+        m->write(out);
+}
+
+//
+// write then rename, which replaces the old file in one step
+//
+bool Metrics::save(const char *file)
+{
+    std::string temp = std::string(file) + ".tmp";
+    FILE *fp = fopen(temp.c_str(), "w");
+    if (! fp) {
+        fprintf(stderr, "unable to write metrics %s\n", temp.c_str());
+        return false;
+    }
+    write(fp);
+    fclose(fp);
+
+#ifdef _WIN32
+    remove(file);               // Windows rename won't replace
+#endif
+    if (rename(temp.c_str(), file) != 0) {
+        fprintf(stderr, "unable to replace metrics %s\n", file);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// counters, gauges and histograms for monitoring a running GLdemo
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include <atomic>
+#include <stdio.h>
+
+// Every metric is a static object, made before main and linked into one
+// list, so instrumented code anywhere (including threads with no
+// AppContext) just updates it, and write() finds them all. Updates are
+// relaxed atomics: cheap enough for every draw call or elevation query,
+// and safe from any thread. write() uses the Prometheus text format.
+//
+// Counters only go up, and are named *_total, so a monitor can take
+// rates. Gauges are set to the current value. Histograms count values
+// into log-spaced buckets in the style of HDR histograms: SUB_BUCKETS
+// linear steps per power of two above the smallest value, so any value
+// is placed within 1/SUB_BUCKETS of its size.
+class Metrics {
+// public types
+public:
+    // what all metrics share
+    class Metric {
+        friend class Metrics;
+    private:
+        Metric *next;           // next in list of all metrics
+    protected:
+        const char *name, *help;
+        Metric(const char *name, const char *help);
+        virtual ~Metric() {}
+        virtual void write(FILE *out) const = 0;
+    };
+
+    // count of something that has happened
+    class Counter : public Metric {
+    private:
+        std::atomic<unsigned long long> value;
+        void write(FILE *out) const;
+    public:
+        Counter(const char *name, const char *help)
+            : Metric(name, help), value(0) {}
+        void add(unsigned long long n = 1) {
+            value.fetch_add(n, std::memory_order_relaxed);
+        }
+    };
+
+    // value that goes up and down
+    class Gauge : public Metric {
+    private:
+        std::atomic<double> value;
+        void write(FILE *out) const;
+    public:
+        Gauge(const char *name, const char *help)
+            : Metric(name, help), value(0) {}
+        void set(double v) { value.store(v, std::memory_order_relaxed); }
+    };
+
+    // distribution of values, such as times
+    class Histogram : public Metric {
+    public:
+        enum {SUB_BUCKETS = 4,  // linear steps per power of two
+              OCTAVES = 20,     // powers of two above smallest
+              NUM_BUCKETS = 1 + SUB_BUCKETS*OCTAVES};
+    private:
+        double smallest;        // top of the first bucket
+        std::atomic<unsigned long long> buckets[NUM_BUCKETS];
+        std::atomic<unsigned long long> count;  // including overflow
+        std::atomic<double> sum;
+        void write(FILE *out) const;
+    public:
+        Histogram(const char *name, const char *help, double smallest);
+        void record(double value);
+
+        // largest value counted in a bucket (inclusive, like the
+        // Prometheus le label), and the bucket for a value, or
+        // NUM_BUCKETS if it is only counted in +Inf
+        double bound(unsigned int bucket) const;
+        unsigned int bucket(double value) const;
+    };
+
+// public data
+public:
+    // GLdemo's metrics
+    static Counter framesDrawn;         // main loop
+    static Histogram frameTime;         // main loop
+    static Gauge pendingJobs;           // main loop
+    static Counter drawCalls;           // Terrain, Marker
+    static Counter triangles;           // Terrain, Marker
+    static Counter elevationQueries;    // Terrain
+    static Counter shaderReloads;       // Terrain, Marker
+    static Counter textureBytes;        // Terrain
+    static Counter glCallsIssued;       // GLState
+    static Counter glCallsElided;       // GLState
+    static Counter viewBuilds;          // Scene
+    static Counter inputEvents;         // Input
+    static Counter simulationSteps;     // Input
+
+// public methods
+public:
+    // write every metric in Prometheus text format
+    static void write(FILE *out);
+
+    // write to file by way of a temporary, so readers never see part of
+    // a snapshot. Returns false on error.
+    static bool save(const char *file);
+};
+
+#endif
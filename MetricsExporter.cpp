@@ -0,0 +1,154 @@
+// publish metrics to a file or local socket for a monitor to collect
+
+#include "MetricsExporter.hpp"
+#include "Metrics.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // ms to wait in poll, so the socket thread notices quit
+    const int POLL_MS = 200;
+
+    // ms to wait for a client to send its request
+    const int REQUEST_MS = 100;
+}
+
+//
+// open the socket, if it is one, then start the thread
+//
+MetricsExporter::MetricsExporter(const char *destination)
+    : listener(-1), thread(0), quit(false)
+{
+    if (strncmp(destination, "unix:", 5) != 0) {
+        path = destination;
+        thread = new std::thread(&MetricsExporter::writeFiles, this);
+        return;
+    }
+    path = destination + 5;
+
+#ifdef _WIN32
+    fprintf(stderr, "metrics: no Unix socket support on Windows\n");
+#else
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "metrics: socket path %s too long\n", path.c_str());
+        return;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    // replace a socket left by an earlier run
+    unlink(path.c_str());
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0
+        || bind(listener, (sockaddr*)&address, sizeof(address)) != 0
+        || listen(listener, 4) != 0) {
+        perror(path.c_str());
+        if (listener >= 0) close(listener);
+        listener = -1;
+        return;
+    }
+
+    // a client hanging up early should not end the program
+    signal(SIGPIPE, SIG_IGN);
+    thread = new std::thread(&MetricsExporter::serve, this);
+#endif
+}
+
+//
+// wake thread to finish, then clean up after it
+//
+MetricsExporter::~MetricsExporter()
+{
+    if (! thread) return;
+    {
+        std::lock_guard<std::mutex> lock(quitLock);
+        quit = true;
+    }
+    wake.notify_one();
+    thread->join();
+    delete thread;
+
+#ifndef _WIN32
+    if (listener >= 0) {
+        close(listener);
+        unlink(path.c_str());
+        return;
+    }
+#endif
+
+    // final numbers
+    Metrics::save(path.c_str());
+}
+
+//
+// file thread: snapshot, then sleep until the next or quit
+//
+void MetricsExporter::writeFiles()
+{
+    std::unique_lock<std::mutex> lock(quitLock);
+    while (! quit) {
+        Metrics::save(path.c_str());
+        wake.wait_for(lock, std::chrono::seconds(INTERVAL));
+    }
+}
+
+//
+// socket thread: answer connections until quit
+//
+void MetricsExporter::serve()
+{
+#ifndef _WIN32
+    for(;;) {
+        {
+            std::lock_guard<std::mutex> lock(quitLock);
+            if (quit) return;
+        }
+
+        pollfd ready = {listener, POLLIN, 0};
+        if (poll(&ready, 1, POLL_MS) <= 0)
+            continue;
+        int client = accept(listener, 0, 0);
+        if (client >= 0)
+            answer(client);
+    }
+#endif
+}
+
+//
+// HTTP if asked that way, else plain text
+//
+void MetricsExporter::answer(int client)
+{
+#ifndef _WIN32
+    // read the request if one comes, though only GET matters
+    char request[1024];
+    ssize_t length = 0;
+    pollfd ready = {client, POLLIN, 0};
+    if (poll(&ready, 1, REQUEST_MS) > 0)
+        length = read(client, request, sizeof(request));
+
+    FILE *out = fdopen(client, "w");
+    if (! out) {
+        close(client);
+        return;
+    }
+    if (length >= 3 && strncmp(request, "GET", 3) == 0)
+        fprintf(out, "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Connection: close\r\n\r\n");
+    Metrics::write(out);
+    fclose(out);                // also closes client
+#endif
+}
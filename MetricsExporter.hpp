@@ -0,0 +1,53 @@
+// publish metrics to a file or local socket for a monitor to collect
+#ifndef MetricsExporter_hpp
+#define MetricsExporter_hpp
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runs on its own thread, so publishing never holds up a frame, and
+// keeps going while the main loop is blocked waiting for input. Given a
+// file, writes a fresh snapshot every INTERVAL seconds, for a collector
+// such as the node exporter's textfile directory. Given unix:path,
+// listens on a Unix domain socket and answers each connection with a
+// snapshot: a plain HTTP response if the client sent a GET, as a
+// Prometheus scrape (or curl --unix-socket) does, else just the text,
+// for socat or nc -U.
+class MetricsExporter {
+// private data
+private:
+    enum {INTERVAL = 1};        // seconds between file snapshots
+
+    std::string path;           // file or socket path
+    int listener;               // listening socket, or -1 for a file
+    std::thread *thread;
+
+    // to stop the thread
+    std::mutex quitLock;
+    std::condition_variable wake;
+    bool quit;
+
+// private methods
+private:
+    // thread main loops
+    void writeFiles();
+    void serve();
+
+    // answer one connection
+    void answer(int client);
+
+// public methods
+public:
+    // start publishing to file or unix:path
+    explicit MetricsExporter(const char *destination);
+
+    // stop, writing a last file snapshot or removing the socket
+    ~MetricsExporter();
+
+    // started successfully
+    bool valid() const { return thread != 0; }
+};
+
+#endif
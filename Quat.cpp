@@ -0,0 +1,40 @@
+// quaternion class template, for rotations
+// non-inline functions
+
+#include "Quat.inl"
+#include "Vec.inl"
+#include <math.h>
+
+// build x, y, or z axis rotation for angle (in radians)
+Quatf xrotateq(float angle) {
+    return quat<float>(sinf(angle/2), 0, 0, cosf(angle/2));
+}
+Quatf yrotateq(float angle) {
+    return quat<float>(0, sinf(angle/2), 0, cosf(angle/2));
+}
+Quatf zrotateq(float angle) {
+    return quat<float>(0, 0, sinf(angle/2), cosf(angle/2));
+}
+
+// the constant quarter turn from z-up to y-up is built at compile time
+static constexpr Quatf Z_UP = quat<float>(-0.70710678f, 0, 0, 0.70710678f);
+
+// view for orbiting camera: all rotations combine into one quaternion,
+// and both translations into one translation by t, so
+// matrix = [R | R*t], inverse = [transpose(R) | -t]
+MatPair4f orbitview4fp(Vec3f view, Vec2f alignment, Vec3f position) {
+    Quatf q = Z_UP * xrotateq(view.y) * zrotateq(view.x)
+        * yrotateq(alignment.x) * xrotateq(alignment.y);
+    Vec3f t = vec3<float>(-position.x, -position.y, -position.z - view.z);
+
+    MatPair4f result = rotate4fp(q);
+    result.matrix[3] = result.matrix * vec4<float>(t.x, t.y, t.z, 1);
+    result.inverse[3] = vec4<float>(-t.x, -t.y, -t.z, 1);
+    return result;
+}
+
+// build rotation by angle (in radians) around any axis
+Quatf rotateq(Vec3f axis, float angle) {
+    Vec3f u = normalize(axis) * sinf(angle/2);
+    return quat<float>(u.x, u.y, u.z, cosf(angle/2));
+}
@@ -0,0 +1,30 @@
+// quaternion class template, for rotations
+#ifndef Quat_hpp
+#define Quat_hpp
+
+#include "Vec.hpp"
+
+//////////////////////////////////////////////////////////////////////
+// quaternion xi + yj + zk + w
+// a rotation by angle a around unit axis u is (u*sin(a/2), cos(a/2))
+template <typename T>
+struct Quat {
+    typedef T value_type;
+
+    union {
+        T data[4];
+        struct { T x, y, z, w; };
+        Vec<T,3> xyz;           // vector part
+    };
+
+    // array-like access must be public member functions
+    // all other operations as template functions in Quat.inl
+    constexpr T operator[](int i) const { return data[i]; }
+    T &operator[](int i) { return data[i]; }
+};
+
+//////////////////////////////////////////////////////////////////////
+// float specialization
+typedef Quat<float> Quatf;
+
+#endif
@@ -0,0 +1,127 @@
+// quaternion class template, for rotations
+// inline functions and function declarations
+#ifndef Quat_inl
+#define Quat_inl
+
+#include "Quat.hpp"
+#include "MatPair.inl"
+#include <math.h>
+
+//////////////////////////////////////////////////////////////////////
+// Build functions. Not done as constructors, so the quaternion will be
+// a POD (plain old data) type, like Vec and Mat. Functions without
+// trig are constexpr, so fixed rotations can be built at compile time.
+
+// build from components
+template <typename T>
+constexpr Quat<T> quat(T x, T y, T z, T w) {
+    return Quat<T>{{{x, y, z, w}}};
+}
+
+// build rotation by angle (in radians) around an axis
+Quatf xrotateq(float angle);
+Quatf yrotateq(float angle);
+Quatf zrotateq(float angle);
+Quatf rotateq(Vec3f axis, float angle);
+
+//////////////////////////////////////////////////////////////////////
+// quaternion product: rotation by q2, then by q1
+template <typename T>
+constexpr Quat<T> operator*(const Quat<T> &q1, const Quat<T> &q2) {
+    return quat<T>(
+        q1.data[3]*q2.data[0] + q1.data[0]*q2.data[3]
+        + q1.data[1]*q2.data[2] - q1.data[2]*q2.data[1],
+        q1.data[3]*q2.data[1] - q1.data[0]*q2.data[2]
+        + q1.data[1]*q2.data[3] + q1.data[2]*q2.data[0],
+        q1.data[3]*q2.data[2] + q1.data[0]*q2.data[1]
+        - q1.data[1]*q2.data[0] + q1.data[2]*q2.data[3],
+        q1.data[3]*q2.data[3] - q1.data[0]*q2.data[0]
+        - q1.data[1]*q2.data[1] - q1.data[2]*q2.data[2]);
+}
+
+// conjugate: inverse rotation for unit quaternions
+template <typename T>
+constexpr Quat<T> conjugate(const Quat<T> &q) {
+    return quat<T>(-q.data[0], -q.data[1], -q.data[2], q.data[3]);
+}
+
+// dot product, length and normalize, as for Vec<T,4>
+template <typename T>
+constexpr T dot(const Quat<T> &q1, const Quat<T> &q2) {
+    return q1.data[0]*q2.data[0] + q1.data[1]*q2.data[1]
+        + q1.data[2]*q2.data[2] + q1.data[3]*q2.data[3];
+}
+
+template <typename T>
+inline T length(const Quat<T> &q) {
+    return sqrt(dot(q,q));
+}
+
+template <typename T>
+inline Quat<T> normalize(const Quat<T> &q) {
+    T len = length(q);
+    return quat<T>(q.x/len, q.y/len, q.z/len, q.w/len);
+}
+
+// spherical interpolation between unit quaternions, for t in [0,1]
+// takes the shorter way around
+template <typename T>
+inline Quat<T> slerp(const Quat<T> &q1, const Quat<T> &q2, T t) {
+    Quat<T> q = q2;
+    T c = dot(q1, q2);
+    if (c < 0) {
+        q = quat<T>(-q.x, -q.y, -q.z, -q.w);
+        c = -c;
+    }
+
+    // nearly the same: linear interpolation avoids dividing by sin ~ 0
+    T s1 = 1-t, s2 = t;
+    if (c < T(0.9995)) {
+        T angle = acos(c), s = sin(angle);
+        s1 = sin((1-t)*angle) / s;
+        s2 = sin(t*angle) / s;
+    }
+    return normalize(quat<T>(s1*q1.x + s2*q.x, s1*q1.y + s2*q.y,
+                             s1*q1.z + s2*q.z, s1*q1.w + s2*q.w));
+}
+
+//////////////////////////////////////////////////////////////////////
+// conversion to matrix
+
+// rotation matrix for unit quaternion q
+// note each row in the source code is one COLUMN in the matrix
+constexpr Mat4f rotate4f(const Quatf &q) {
+    return mat4<float>(
+        1 - 2*(q.data[1]*q.data[1] + q.data[2]*q.data[2]),
+        2*(q.data[0]*q.data[1] + q.data[3]*q.data[2]),
+        2*(q.data[0]*q.data[2] - q.data[3]*q.data[1]),
+        0,
+
+        2*(q.data[0]*q.data[1] - q.data[3]*q.data[2]),
+        1 - 2*(q.data[0]*q.data[0] + q.data[2]*q.data[2]),
+        2*(q.data[1]*q.data[2] + q.data[3]*q.data[0]),
+        0,
+
+        2*(q.data[0]*q.data[2] + q.data[3]*q.data[1]),
+        2*(q.data[1]*q.data[2] - q.data[3]*q.data[0]),
+        1 - 2*(q.data[0]*q.data[0] + q.data[1]*q.data[1]),
+        0,
+
+        0, 0, 0, 1);
+}
+
+// rotation matrix and inverse for unit quaternion q
+constexpr MatPair4f rotate4fp(const Quatf &q) {
+    return MatPair4f{rotate4f(q), rotate4f(conjugate(q))};
+}
+
+// view matrix and inverse for a camera at spherical view angles
+// (view.x, view.y) and distance view.z from position, tilted by the
+// surface alignment angles. Same as the chained product
+//     xrotate4fp(-pi/2) * xrotate4fp(view.y) * zrotate4fp(view.x)
+//     * yrotate4fp(alignment.x) * xrotate4fp(alignment.y)
+//     * translate4fp(0, 0, -view.z) * translate4fp(-position)
+// but with one rotation and one translation
+MatPair4f orbitview4fp(Vec3f view, Vec2f alignment, Vec3f position);
+
+#endif
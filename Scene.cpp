@@ -6,8 +6,12 @@
 #include "Terrain.hpp"
 #include "AppContext.hpp"
 #include "Marker.hpp"
+#include "UniformRing.hpp"
+#include "CpuProfiler.hpp"
+#include "Metrics.hpp"
 
 #include "MatPair.inl"
+#include "Quat.inl"
 #include "Vec.inl"
 
 // using core modern OpenGL
@@ -24,43 +28,43 @@
 //
 // create and initialize view
 //
-Scene::Scene(GLFWwindow *win, Marker &lightmarker) : 
+Scene::Scene(AppContext *appctx, int w, int h, Marker &lightmarker) : 
+    viewChanged(true),
     viewSph(vec3<float>(0.f, 0.f, 5.f)),
     lightSph(vec3<float>(0.5f * F_PI, 0.25f * F_PI, 300.f)),
 	positionSph(vec3<float>(0.f, 0.f, 0.f)),
 	alignmentSph(vec2<float>(0.f, 0.f)),
 	orientation(F_PI / 2)
 {
-    // create uniform buffer objects
-    glGenBuffers(NUM_BUFFERS, bufferIDs);
-    glBindBuffer(GL_UNIFORM_BUFFER, bufferIDs[UNIFORM_BUFFER]);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShaderData), 0, GL_STREAM_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, AppContext::SCENE_UNIFORMS,
-                     bufferIDs[UNIFORM_BUFFER]);
-	
-	AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
-
     // initialize scene data
 	appctx->terrain->getElevation(positionSph.x, positionSph.y, positionSph.z, alignmentSph.x, alignmentSph.y);
-    viewport(win);
+    viewport(w, h);
     view();
     light(lightmarker);
-    sdata.fog = 0;                    // fog off
 }
 
 //
 // New view, pointing to origin, at specified angle
+// Many input events may change the view in one frame, so just note
+// the change here and build the matrix once in update
 //
 void Scene::view()
 {
-    // update view matrix
-    sdata.viewmat =  xrotate4fp(-F_PI/2)
-		* xrotate4fp(viewSph.y)
-		* zrotate4fp(viewSph.x)
-        * yrotate4fp(alignmentSph.x)
-        * xrotate4fp(alignmentSph.y)
-		* translate4fp(vec3<float>(0, 0,-viewSph.z))
-		* translate4fp(-1.f * positionSph);
+    viewChanged = true;
+}
+
+//
+// build view matrix and inverse from the view parameters
+// MathTest checks this matches the chain of MatPair products it replaced
+//
+void Scene::buildView()
+{
+    CpuProfiler::Zone zone("Scene::buildView");
+    Metrics::viewBuilds.add();
+
+    sdata.viewmat = orbitview4fp(viewSph, alignmentSph, positionSph);
+
+    viewChanged = false;
 }
 
 //
@@ -70,7 +74,18 @@ void Scene::view()
 void Scene::viewport(GLFWwindow *win)
 {
     // get window dimensions
-    glfwGetFramebufferSize(win, &width, &height);
+    int w, h;
+    glfwGetFramebufferSize(win, &w, &h);
+    viewport(w, h);
+}
+
+//
+// set viewport and projection for a given framebuffer size
+//
+void Scene::viewport(int w, int h)
+{
+    width = w;
+    height = h;
 
     // this viewport makes a 1 to 1 mapping of physical pixels to GL
     // "logical" pixels
@@ -99,10 +114,14 @@ void Scene::light(Marker &lightmarker)
 //
 // call before drawing each frame to update per-frame scene state
 //
-void Scene::update() const
+void Scene::update(UniformRing &uniforms)
 {
+    CpuProfiler::Zone zone("Scene::update");
+
+    // rebuild view matrix if it changed since last frame
+    if (viewChanged)
+        buildView();
+
     // update uniform block
-    glBindBuffer(GL_UNIFORM_BUFFER, bufferIDs[UNIFORM_BUFFER]);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShaderData), &sdata);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    uniforms.bind(AppContext::SCENE_UNIFORMS, &sdata, sizeof(ShaderData));
 }
@@ -7,21 +7,26 @@
 #include "MatPair.hpp"
 
 class Marker;
+class UniformRing;
+struct AppContext;
 struct GLFWwindow;
 
 class Scene {
 // private data
 private:
-    // GL uniform buffer IDs
-    enum {UNIFORM_BUFFER, NUM_BUFFERS};
-    unsigned int bufferIDs[NUM_BUFFERS];
+    bool viewChanged;       // view parameters changed since last update
+
+// private methods
+private:
+    // rebuild view matrix from viewSph, alignmentSph and positionSph
+    void buildView();
 
 // public data
 public:
     struct ShaderData {
         MatPair4f viewmat, projection; // viewing matrices
         Vec3f lightpos;		       // light position
-        int fog;		       // 1 = display fog, 0 = don't
+        float pad;		       // std140 rounds vec3 up to 4 floats
     } sdata;
 
     int width, height;         // current window dimensions
@@ -34,20 +39,22 @@ public:
 
 // public methods
 public:
-    // create with initial window size and orbit location
-    Scene(GLFWwindow *win, Marker &lightMarker);
+    // create with initial framebuffer size and orbit location
+    Scene(AppContext *appctx, int width, int height, Marker &lightMarker);
 
     // set up new window viewport and projection
     void viewport(GLFWwindow *win);
+    void viewport(int width, int height);
 
-    // set view using orbitAngle
+    // note view parameters have changed
+    // matrix is rebuilt once, on the next update
     void view();
 
     // update light
     void light(Marker &lightMarker);
 
     // update shader uniform state each frame
-    void update() const;
+    void update(UniformRing &uniforms);
 };
 
 #endif
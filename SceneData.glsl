@@ -0,0 +1,8 @@
+// per-frame data shared by all shaders in terrain demo
+// must match Scene::ShaderData
+layout(std140)                  // use standard layout
+uniform SceneData {             // uniform struct name
+    mat4 viewMatrix, viewInverse;
+    mat4 projectionMatrix, projectionInverse;
+    vec3 lightpos;
+};
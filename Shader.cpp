@@ -1,45 +1,239 @@
 // functions to load shaders
 
 #include "Shader.hpp"
+#include "Hash.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #ifdef _WIN32
 // don't complain if we use standard IO functions instead of windows-only
 #pragma warning( disable: 4996 )
 #endif
 
+// program binary cache file format: header followed by binary data.
+// key covers shader sources and the driver, since binaries are only
+// valid for the exact driver that produced them
+namespace {
+    const char PROGRAM_CACHE_MAGIC[4] = {'G','L','P','B'};
+    const unsigned int PROGRAM_CACHE_VERSION = 1;
+
+    struct ProgramCacheHeader {
+        char magic[4];          // PROGRAM_CACHE_MAGIC
+        unsigned int version;   // PROGRAM_CACHE_VERSION
+        unsigned long long key; // hash of sources and driver
+        unsigned int format;    // GL binary format
+        unsigned int size;      // binary size in bytes
+    };
+
+    bool cacheEnabled = true;
+
+    // binaries fetched on the GL thread, waiting for the writer thread
+    // so a rebuild doesn't stall a frame on file IO
+    struct PendingBinary {
+        std::string file;       // cache file name
+        ProgramCacheHeader header;
+        std::vector<char> binary;
+    };
+    std::deque<PendingBinary> pendingBinaries;
+    std::mutex pendingLock;
+    std::condition_variable pendingReady;
+    bool writerStopping = false;    // tell writer to finish
+    std::thread *cacheWriter = 0;   // started by the first save
+
+    // every file read by the preprocessor. A deque so the strings
+    // don't move, since shaderFile hands out pointers to them
+    std::deque<std::string> sourceFiles;
+
+    // deepest allowed #include nesting, to catch include loops
+    const int MAX_INCLUDE_DEPTH = 16;
+}
+
+unsigned int shaderCacheHits = 0, shaderCacheMisses = 0;
+
 //
-// load and compile a single shader
-// id is an existing shader object
-// shader type is defined by shader object type
+// enable or disable program binary cache
 //
-bool loadShader(unsigned int id, const char *file)
+void shaderCache(bool enable)
+{
+    cacheEnabled = enable;
+}
+
+//
+// read an entire shader file into a new[] buffer
+// return 0 if the file can't be read
+//
+static GLchar *readShader(const char *file, int &size)
 {
     // open file
     FILE *f = fopen(file, "rb");
     if (! f) {
         fprintf(stderr, "unable to open shader %s\n", file);
-        return false;           // error
+        return 0;               // error
     }
 
     // get file size
     // seek to end of file is more cross-platform than fstat
     fseek(f, 0, SEEK_END);
-    int size = ftell(f);
+    size = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    // read entire file and compile as shader
+    // read entire file
     GLchar *shader = new GLchar[size];
     fread(shader, 1, size, f);
-    glShaderSource(id, 1, (const GLchar**)(&shader), &size);
-    glCompileShader(id);
-    delete[] shader;
+    fclose(f);
+    return shader;
+}
+
+//
+// index of file in sourceFiles, adding it if necessary
+//
+static unsigned int sourceNumber(const std::string &file)
+{
+    for(unsigned int i=0; i<sourceFiles.size(); ++i)
+        if (sourceFiles[i] == file)
+            return i;
+    sourceFiles.push_back(file);
+    return (unsigned int)sourceFiles.size() - 1;
+}
+
+unsigned int numShaderFiles()
+{
+    return (unsigned int)sourceFiles.size();
+}
+
+const char *shaderFile(unsigned int i)
+{
+    return sourceFiles[i].c_str();
+}
+
+//
+// append file to source, expanding #include "file" lines
+// #line directives keep compiler errors pointing at the right file:
+// errors show as "N(line)", where N is the shaderFile number
+// return false if any file can't be read
+//
+static bool includeShader(const std::string &file, std::string &source,
+                          int depth)
+{
+    if (depth > MAX_INCLUDE_DEPTH) {
+        fprintf(stderr, "shader includes nested too deep in %s\n",
+                file.c_str());
+        return false;
+    }
+
+    int size;
+    GLchar *text = readShader(file.c_str(), size);
+    if (! text)
+        return false;
+    unsigned int fileNum = sourceNumber(file);
+
+    // includes are relative to the including file
+    std::string dir;
+    size_t slash = file.find_last_of("/\\");
+    if (slash != std::string::npos)
+        dir = file.substr(0, slash+1);
+
+    bool success = true;
+    const char *line = text, *end = text + size;
+    for(int lineNum = 1; success && line < end; ++lineNum) {
+        const char *next = (const char*)memchr(line, '\n', end - line);
+        next = next ? next+1 : end;
+
+        // is this an #include line?
+        const char *c = line;
+        while (c < next && (*c == ' ' || *c == '\t')) ++c;
+        const char *open, *close;
+        if (next - c > 8 && strncmp(c, "#include", 8) == 0
+            && (open = (const char*)memchr(c+8, '"', next-c-8)) != 0
+            && (close = (const char*)memchr(open+1, '"', next-open-1)) != 0) {
+            char lineDirective[64];
+            snprintf(lineDirective, sizeof(lineDirective), "#line 1 %u\n",
+                     sourceNumber(dir + std::string(open+1, close)));
+            source += lineDirective;
+            success = includeShader(dir + std::string(open+1, close),
+                                    source, depth+1);
+
+            // back to this file
+            snprintf(lineDirective, sizeof(lineDirective), "#line %d %u\n",
+                     lineNum+1, fileNum);
+            source += lineDirective;
+        }
+        else
+            source.append(line, next);
+        if (next == end && next[-1] != '\n')
+            source += '\n';
+        line = next;
+    }
+
+    delete[] text;
+    return success;
+}
+
+//
+// load shader file, expanding #include lines, and add extra #define
+// lines right after the #version line
+//
+bool preprocessShader(const char *file, const char *defines,
+                      std::string &source)
+{
+    source.clear();
+    std::string body;
+    if (! includeShader(file, body, 0))
+        return false;
+
+    // #version must come before anything but comments, so add defines
+    // just after it
+    size_t start = 0;
+    int nextLine = 1;
+    size_t version = body.find("#version");
+    if (version != std::string::npos) {
+        start = body.find('\n', version);
+        start = (start == std::string::npos) ? body.size() : start+1;
+        for(size_t i=0; i<start; ++i)
+            if (body[i] == '\n') ++nextLine;
+    }
+    source.append(body, 0, start);
+    if (defines) {
+        source += defines;
+        if (source[source.size()-1] != '\n')
+            source += '\n';
+        char lineDirective[64];
+        snprintf(lineDirective, sizeof(lineDirective), "#line %d %u\n",
+                 nextLine, sourceNumber(file));
+        source += lineDirective;
+    }
+    source.append(body, start, std::string::npos);
+    return true;
+}
+
+//
+// print which file is which in compiler messages
+//
+static void reportSourceNumbers()
+{
+    fprintf(stderr, "shader source numbers:");
+    for(unsigned int i=0; i<sourceFiles.size(); ++i)
+        fprintf(stderr, " %u=%s", i, sourceFiles[i].c_str());
+    fprintf(stderr, "\n");
+}
 
+//
+// report compile errors for a shader
+// return false on compile error
+//
+static bool checkShader(unsigned int id)
+{
     // report compile errors
     GLint success;
     glGetShaderiv(id, GL_COMPILE_STATUS, &success);
@@ -62,44 +256,387 @@ bool loadShader(unsigned int id, const char *file)
     return true;                // success
 }
 
+//
+// load and compile a single shader
+// id is an existing shader object
+// shader type is defined by shader object type
+//
+bool loadShader(unsigned int id, const char *file)
+{
+    std::string source;
+    if (! preprocessShader(file, 0, source))
+        return false;           // error
+
+    const GLchar *shader = source.c_str();
+    glShaderSource(id, 1, &shader, 0);
+    glCompileShader(id);
+    if (checkShader(id))
+        return true;
+
+    reportSourceNumbers();
+    return false;
+}
 
 //
-// load a set of shaders
+// can this driver save and restore program binaries?
 //
-bool loadShaders(unsigned int progID,
-                 unsigned int numComponents,
-                 ShaderInfo *components)
+static bool binaryCacheSupported()
 {
-    // load shader code
+    if (! cacheEnabled || ! GLEW_ARB_get_program_binary)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+//
+// cache key: preprocessed shader sources plus everything identifying
+// the driver
+// return 0, for no caching, if the driver strings aren't available
+//
+static unsigned long long programKey(unsigned int numComponents,
+                                     const std::string *sources)
+{
+    const GLenum driver[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    unsigned long long key = hashBytes(0, 0);
+    for(unsigned int i=0; i<sizeof(driver)/sizeof(*driver); ++i) {
+        const char *name = (const char*)glGetString(driver[i]);
+        if (! name) return 0;
+        key = hashString(name, key);
+    }
+    for(unsigned int i=0; i<numComponents; ++i)
+        key = hashString(sources[i].c_str(), key);
+    return key;
+}
+
+//
+// cache file name for this set of shader files and defines
+//
+static void programCacheFile(unsigned int numComponents,
+                             const ShaderInfo *components,
+                             char *name, size_t nameSize)
+{
+    unsigned long long nameHash = hashBytes(0, 0);
     for(unsigned int i=0; i<numComponents; ++i) {
-        if (! loadShader(components[i].id, components[i].file))
-            return false;       // error
+        nameHash = hashString(components[i].file, nameHash);
+        if (components[i].defines)
+            nameHash = hashString(components[i].defines, nameHash);
     }
+    snprintf(name, nameSize, "shader-%08x.bin", (unsigned int)nameHash);
+}
 
-    // link shader programs
-    // don't attach until everything compiles successfully to avoid
-    // extraneous attach affecting next attempt to link if there was an error
-    for(unsigned int i=0; i<numComponents; ++i)
-        glAttachShader(progID, components[i].id);
-    glLinkProgram(progID);
+//
+// try to load program from binary cache
+// return false if there is no valid binary for this key
+// the binary must fill the rest of the file, so a damaged size can't
+// ask for a huge allocation
+//
+static bool loadProgramBinary(unsigned int progID, const char *cacheFile,
+                              unsigned long long key)
+{
+    FILE *fp = fopen(cacheFile, "rb");
+    if (! fp)
+        return false;
+    fseek(fp, 0, SEEK_END);
+    long fileSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    ProgramCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1
+        && memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == PROGRAM_CACHE_VERSION
+        && header.key == key
+        && fileSize >= long(sizeof(header))
+        && header.size == (unsigned long)fileSize - sizeof(header);
+
+    char *binary = 0;
+    if (valid) {
+        binary = new char[header.size];
+        valid = fread(binary, 1, header.size, fp) == header.size;
+    }
+    fclose(fp);
+
+    // driver may still reject it (e.g. after an update with the same
+    // version string), which shows up as a link failure
+    GLint success = GL_FALSE;
+    if (valid) {
+        glProgramParameteri(progID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+        glProgramBinary(progID, header.format, binary, header.size);
+        glGetProgramiv(progID, GL_LINK_STATUS, &success);
+    }
+    delete[] binary;
+    return success == GL_TRUE;
+}
+
+//
+// write one binary to its cache file
+// written to a temporary file first so a partial write is never used
+//
+static void writeProgramBinary(const PendingBinary &pending)
+{
+    const char *cacheFile = pending.file.c_str();
+    char tmpFile[1024];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", cacheFile);
+    FILE *fp = fopen(tmpFile, "wb");
+    if (! fp) {
+        fprintf(stderr, "unable to write shader cache %s\n", tmpFile);
+        return;
+    }
+    bool ok = fwrite(&pending.header, sizeof(pending.header), 1, fp) == 1
+        && fwrite(&pending.binary[0], 1, pending.binary.size(), fp)
+           == pending.binary.size();
+    ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+    remove(cacheFile);          // windows rename won't replace
+#endif
+    if (! ok || rename(tmpFile, cacheFile) != 0) {
+        fprintf(stderr, "unable to write shader cache %s\n", cacheFile);
+        remove(tmpFile);
+    }
+}
+
+//
+// writer thread main loop: write binaries in the order they were saved
+//
+static void writeProgramBinaries()
+{
+    for(;;) {
+        PendingBinary pending;
+        {
+            std::unique_lock<std::mutex> guard(pendingLock);
+            pendingReady.wait(guard, []{
+                    return writerStopping || !pendingBinaries.empty();
+                });
+            if (pendingBinaries.empty())
+                return;         // stopping and nothing left
+            std::swap(pending, pendingBinaries.front());
+            pendingBinaries.pop_front();
+        }
+        writeProgramBinary(pending);
+    }
+}
+
+//
+// save linked program to binary cache
+// the binary is fetched here, on the GL thread, and written to disk by
+// the writer thread
+//
+static void saveProgramBinary(unsigned int progID, const char *cacheFile,
+                              unsigned long long key)
+{
+    GLint size = 0;
+    glGetProgramiv(progID, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    PendingBinary pending;
+    pending.file = cacheFile;
+    memcpy(pending.header.magic, PROGRAM_CACHE_MAGIC,
+           sizeof(pending.header.magic));
+    pending.header.version = PROGRAM_CACHE_VERSION;
+    pending.header.key = key;
+    pending.binary.resize(size);
+    GLenum format;
+    glGetProgramBinary(progID, size, 0, &format, &pending.binary[0]);
+    pending.header.format = format;
+    pending.header.size = size;
+
+    {
+        std::lock_guard<std::mutex> guard(pendingLock);
+        pendingBinaries.push_back(std::move(pending));
+        if (! cacheWriter)
+            cacheWriter = new std::thread(writeProgramBinaries);
+    }
+    pendingReady.notify_one();
+}
+
+//
+// write any binaries still waiting, then stop the writer thread
+//
+void finishShaderCache()
+{
+    if (! cacheWriter)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(pendingLock);
+        writerStopping = true;
+    }
+    pendingReady.notify_one();
+    cacheWriter->join();
+    delete cacheWriter;
+    cacheWriter = 0;
+    writerStopping = false;
+}
+
+
+//
+// are compiles asynchronous, so we can ask if they are done?
+//
+static bool parallelCompile()
+{
+#ifdef GL_KHR_parallel_shader_compile
+    static bool initialized = false;
+    if (GLEW_KHR_parallel_shader_compile) {
+        // let the driver choose how many compiler threads to use
+        if (! initialized)
+            glMaxShaderCompilerThreadsKHR(0xffffffff);
+        initialized = true;
+        return true;
+    }
+#endif
+    return false;
+}
+
+//
+// abandon any build in progress
+//
+void cancelShaders(ShaderBuild &build)
+{
+    for(unsigned int i=0; i<build.numComponents; ++i)
+        glDeleteShader(build.shaderIDs[i]);
+    if (build.progID)
+        glDeleteProgram(build.progID);
+    build.progID = 0;
+    build.numComponents = 0;
+}
+
+//
+// start building a new program
+// compile and link are only issued here; results are checked in
+// pollShaders, so a driver with background compile threads can work
+// while we keep drawing with the old program
+//
+bool startShaders(ShaderBuild &build,
+                  unsigned int numComponents,
+                  const ShaderInfo *components)
+{
+    // a newer request replaces anything in progress
+    cancelShaders(build);
+    if (numComponents > ShaderBuild::MAX_COMPONENTS) {
+        fprintf(stderr, "too many shader components for %s: %u, at most %u\n",
+                components[0].file, numComponents,
+                (unsigned int)ShaderBuild::MAX_COMPONENTS);
+        return false;
+    }
+
+    // preprocess all sources first, so an unreadable file doesn't
+    // leave a partial build behind
+    std::string sources[ShaderBuild::MAX_COMPONENTS];
+    for(unsigned int i=0; i<numComponents; ++i) {
+        if (! preprocessShader(components[i].file, components[i].defines,
+                               sources[i]))
+            return false;
+    }
+
+    build.progID = glCreateProgram();
+    build.components = components;
+
+    // use cached binary if sources and driver haven't changed
+    build.key = 0;
+    if (binaryCacheSupported()) {
+        programCacheFile(numComponents, components,
+                         build.cacheFile, sizeof(build.cacheFile));
+        build.key = programKey(numComponents, sources);
+    }
+    if (build.key) {
+        if (loadProgramBinary(build.progID, build.cacheFile, build.key)) {
+            ++shaderCacheHits;
+            build.key = 0;      // already cached
+            return true;
+        }
+        glProgramParameteri(build.progID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                            GL_TRUE);
+    }
+    ++shaderCacheMisses;
+
+    // issue compiles and link without checking results
+    parallelCompile();
+    build.numComponents = numComponents;
+    for(unsigned int i=0; i<numComponents; ++i) {
+        const GLchar *source = sources[i].c_str();
+        build.shaderIDs[i] = glCreateShader(components[i].type);
+        glShaderSource(build.shaderIDs[i], 1, &source, 0);
+        glCompileShader(build.shaderIDs[i]);
+        glAttachShader(build.progID, build.shaderIDs[i]);
+    }
+    glLinkProgram(build.progID);
+    return true;
+}
+
+//
+// check on a build
+//
+ShaderStatus pollShaders(ShaderBuild &build, bool wait, unsigned int &progID)
+{
+    if (! build.progID)
+        return SHADER_IDLE;
+
+    // without the parallel compile extension, asking for link status
+    // would block until the compile is done
+    if (! wait && build.numComponents && parallelCompile()) {
+        GLint done;
+        glGetProgramiv(build.progID, GL_COMPLETION_STATUS_KHR, &done);
+        if (! done)
+            return SHADER_BUILDING;
+    }
 
     // report link errors
     GLint success;
-    glGetProgramiv(progID, GL_LINK_STATUS, &success);
+    glGetProgramiv(build.progID, GL_LINK_STATUS, &success);
     if (! success) {
+        // compile errors are more useful, if there were any
+        bool compileError = false;
+        for(unsigned int i=0; i<build.numComponents; ++i) {
+            if (! checkShader(build.shaderIDs[i]))
+                compileError = true;
+        }
+        if (compileError)
+            reportSourceNumbers();
+
         // how big is the message?
         GLsizei infoLen;
-        glGetProgramiv(progID, GL_INFO_LOG_LENGTH, &infoLen);
+        glGetProgramiv(build.progID, GL_INFO_LOG_LENGTH, &infoLen);
 
         // print the message
         char *infoLog = new char[infoLen];
-        glGetProgramInfoLog(progID, infoLen, 0, infoLog);
+        glGetProgramInfoLog(build.progID, infoLen, 0, infoLog);
         fprintf(stderr, "%s", infoLog);
 
         // free the message buffer
         delete[] infoLog;
-        return false;           // error
+
+        cancelShaders(build);
+        return SHADER_FAILED;   // error
     }
 
-    return true;                // success
+    // save for next time
+    if (build.key)
+        saveProgramBinary(build.progID, build.cacheFile, build.key);
+
+    // shader objects are no longer needed once linked
+    for(unsigned int i=0; i<build.numComponents; ++i) {
+        glDetachShader(build.progID, build.shaderIDs[i]);
+        glDeleteShader(build.shaderIDs[i]);
+    }
+    build.numComponents = 0;
+
+    // hand program to caller
+    progID = build.progID;
+    build.progID = 0;
+    return SHADER_READY;        // success
+}
+
+//
+// build a program, waiting for the result
+//
+unsigned int loadShaders(unsigned int numComponents,
+                         const ShaderInfo *components)
+{
+    ShaderBuild build;
+    unsigned int progID = 0;
+    if (startShaders(build, numComponents, components))
+        pollShaders(build, true, progID);
+    return progID;
 }
@@ -2,24 +2,87 @@
 #ifndef Shader_hpp
 #define Shader_hpp
 
+#include <string>
+
 // info we need to load a single shader
 struct ShaderInfo {
-    unsigned int id;            // shader object ID
-    const char *file;           // file to load into this object
+    unsigned int type;          // shader type (GL_VERTEX_SHADER, etc.)
+    const char *file;           // file to load into this shader
+    const char *defines;        // #define lines to add to source, or 0
+};
+
+// state for building a new program object in the background
+// a build either finishes with a fully linked program, or fails and
+// leaves nothing behind, so a working program is never disturbed
+struct ShaderBuild {
+    enum {MAX_COMPONENTS = 4};
+    unsigned int progID;        // program being built, 0 if none
+    unsigned int numComponents; // shader objects in this build
+    unsigned int shaderIDs[MAX_COMPONENTS];
+    const ShaderInfo *components;   // source files, for error reports
+    unsigned long long key;     // binary cache key, 0 if not caching
+    char cacheFile[64];         // binary cache file name
+
+    ShaderBuild() : progID(0), numComponents(0), components(0), key(0) {}
 };
 
+// results of checking on a ShaderBuild
+enum ShaderStatus {
+    SHADER_IDLE,                // no build in progress
+    SHADER_BUILDING,            // still compiling or linking
+    SHADER_READY,               // linked successfully
+    SHADER_FAILED               // compile or link error (already reported)
+};
+
+// load shader source from file into source string
+// expands any #include "file" lines, relative to the including file,
+// and adds defines (lines of "#define NAME value") after #version
+// return false if any file can't be read
+bool preprocessShader(const char *file, const char *defines,
+                      std::string &source);
+
+// all shader files read so far, including #include files
+// compiler messages refer to file i as source string i
+unsigned int numShaderFiles();
+const char *shaderFile(unsigned int i);
+
 // load shader from file into id = existing shader object
 // shader type is defined by shader object type
 // return false on compile error
 bool loadShader(unsigned int id, const char *file);
 
-// load a set of shaders
-// progID is the program object
+// start building a new program from a set of shaders
 // components[numComponents] is a list of shader components to link
-// return false on compile error
-bool loadShaders(unsigned int progID, 
-                 unsigned int numComponents,
-                 ShaderInfo *components);
+// uses a cached program binary when sources and driver are unchanged
+// replaces any build already in progress
+// return false if a shader file can't be read
+bool startShaders(ShaderBuild &build,
+                  unsigned int numComponents,
+                  const ShaderInfo *components);
+
+// check on a build without blocking, unless wait is true
+// on SHADER_READY, progID is set to the new program, and the caller
+// owns it. The build is idle again after SHADER_READY or SHADER_FAILED
+ShaderStatus pollShaders(ShaderBuild &build, bool wait,
+                         unsigned int &progID);
+
+// abandon any build in progress
+void cancelShaders(ShaderBuild &build);
+
+// build a program, waiting for the result
+// return new program ID, or 0 on compile or link error
+unsigned int loadShaders(unsigned int numComponents,
+                         const ShaderInfo *components);
+
+// enable or disable the on-disk program binary cache (default on)
+void shaderCache(bool enable);
+
+// new binaries are written to the cache on a background thread
+// wait for any still being written, e.g. before exit
+void finishShaderCache();
+
+// number of programs loaded from binary cache and compiled so far
+extern unsigned int shaderCacheHits, shaderCacheMisses;
 
 
 // load set of shaders
@@ -0,0 +1,151 @@
+// notice when shader source files change on disk
+
+#include "ShaderWatcher.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// seconds between modification time checks when polling
+#define POLL_INTERVAL 0.5
+
+//
+// current time in seconds
+//
+static double now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// file modification time, or 0 if it doesn't exist
+//
+static long long modificationTime(const char *file)
+{
+    struct stat info;
+    if (stat(file, &info) != 0)
+        return 0;
+    return (long long)info.st_mtime;
+}
+
+//
+// part of path after the directory
+//
+static const char *baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash+1 : path;
+}
+
+//
+// set up inotify if we can
+//
+ShaderWatcher::ShaderWatcher()
+    : numFiles(0), inotifyFD(-1), checkTime(0)
+{
+#ifdef __linux__
+    inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+//
+// stop watching
+//
+ShaderWatcher::~ShaderWatcher()
+{
+#ifdef __linux__
+    if (inotifyFD >= 0)
+        close(inotifyFD);
+#endif
+}
+
+//
+// add file to watch list
+//
+void ShaderWatcher::watch(const char *file)
+{
+    // already watching
+    for(unsigned int i=0; i<numFiles; ++i)
+        if (strcmp(files[i], file) == 0)
+            return;
+
+    if (numFiles == MAX_FILES) {
+        fprintf(stderr, "too many watched shaders, ignoring %s\n", file);
+        return;
+    }
+    files[numFiles] = file;
+    modTimes[numFiles] = modificationTime(file);
+    watchIDs[numFiles] = -1;
+
+#ifdef __linux__
+    // watch the directory: an editor may replace the file entirely
+    if (inotifyFD >= 0) {
+        char dir[1024] = ".";
+        const char *base = baseName(file);
+        if (base != file) {
+            size_t len = base - file;
+            if (len >= sizeof(dir)) len = sizeof(dir)-1;
+            memcpy(dir, file, len);
+            dir[len] = 0;
+        }
+        // watching the same directory again returns the same ID
+        watchIDs[numFiles] = inotify_add_watch(inotifyFD, dir,
+                                               IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+#endif
+    ++numFiles;
+}
+
+//
+// check for changes since last call
+//
+bool ShaderWatcher::changed()
+{
+    bool any = false;
+
+#ifdef __linux__
+    if (inotifyFD >= 0) {
+        // drain all queued events; read fails with EAGAIN when empty
+        char buffer[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(inotifyFD, buffer, sizeof(buffer))) > 0) {
+            for(char *ptr = buffer; ptr < buffer + len;
+                ptr += sizeof(struct inotify_event) + 
+                    ((struct inotify_event*)ptr)->len) {
+                const struct inotify_event *event = 
+                    (const struct inotify_event*)ptr;
+                if (event->len == 0) continue;
+                for(unsigned int i=0; i<numFiles; ++i) {
+                    if (event->wd == watchIDs[i]
+                        && strcmp(event->name, baseName(files[i])) == 0)
+                        any = true;
+                }
+            }
+        }
+        return any;
+    }
+#endif
+
+    // fall back to checking modification times
+    double t = now();
+    if (t - checkTime < POLL_INTERVAL)
+        return false;
+    checkTime = t;
+    for(unsigned int i=0; i<numFiles; ++i) {
+        long long modTime = modificationTime(files[i]);
+        if (modTime != modTimes[i]) {
+            modTimes[i] = modTime;
+            any = true;
+        }
+    }
+    return any;
+}
@@ -0,0 +1,33 @@
+// notice when shader source files change on disk
+#ifndef ShaderWatcher_hpp
+#define ShaderWatcher_hpp
+
+// On Linux, uses inotify on the directories holding the files, which
+// also catches editors that save by renaming a new file into place.
+// Elsewhere, falls back to checking file modification times a few
+// times a second. Either way, checking never blocks.
+class ShaderWatcher {
+// private data
+private:
+    enum {MAX_FILES = 16};
+    const char *files[MAX_FILES];   // watched files
+    int watchIDs[MAX_FILES];        // inotify watch for file's directory
+    long long modTimes[MAX_FILES];  // last modification time seen
+    unsigned int numFiles;
+
+    int inotifyFD;              // inotify instance, or -1 to poll
+    double checkTime;           // time of last modification time check
+
+// public methods
+public:
+    ShaderWatcher();
+    ~ShaderWatcher();
+
+    // add a file to watch, if not already watched
+    void watch(const char *file);
+
+    // return true if any watched file has changed since the last call
+    bool changed();
+};
+
+#endif
@@ -0,0 +1,208 @@
+// run input handling and movement apart from drawing
+
+#include "Simulation.hpp"
+#include "FramePacer.hpp"
+#include "CpuProfiler.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+namespace {
+    // wait between updates while moving (in seconds): several per
+    // displayed frame, so a frame never shows an old view for long
+    const double ACTIVE_WAIT = 1.0 / 240;
+}
+
+//
+// copy starting view, and start thread if asked
+//
+Simulation::Simulation(const Scene &initial, const Terrain &ground,
+                       GLFWwindow *window, bool threaded)
+    : scene(initial), terrain(ground), win(window), published(false),
+      thread(0), sleeping(false), quit(false)
+{
+    Snapshot &first = snapshots.write();
+    first.viewSph = scene.viewSph;
+    first.positionSph = scene.positionSph;
+    first.alignmentSph = scene.alignmentSph;
+    first.active = false;
+    snapshots.publish();
+
+    if (threaded)
+        thread = new std::thread(&Simulation::run, this);
+}
+
+//
+// tell thread to finish, and wait for it
+//
+Simulation::~Simulation()
+{
+    if (thread) {
+        quit = true;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+        thread->join();
+        delete thread;
+    }
+}
+
+//
+// queue event for the simulation thread, waking it if it is asleep.
+// Synchronous input goes straight to Input, as it always has.
+//
+void Simulation::send(const Event &event)
+{
+    if (! thread) {
+        apply(event);
+        return;
+    }
+
+    // full only if the simulation thread is badly stalled, and dropping
+    // a key release would leave us moving forever
+    while (! events.push(event))
+        std::this_thread::yield();
+
+    // pairs with the fence in run: either it sees this event, or we see
+    // that it is sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+//
+// forward events
+//
+void Simulation::keyPress(int key)
+{
+    Event e = {Event::KEY_PRESS, key, 0, 0, 0};
+    send(e);
+}
+
+void Simulation::keyRelease(int key)
+{
+    Event e = {Event::KEY_RELEASE, key, 0, 0, 0};
+    send(e);
+}
+
+void Simulation::mouseButton(int button, int action)
+{
+    Event e = {Event::MOUSE_BUTTON, button, action, 0, 0};
+    send(e);
+}
+
+void Simulation::mouseMove(double x, double y)
+{
+    Event e = {Event::MOUSE_MOVE, 0, 0, x, y};
+    send(e);
+}
+
+void Simulation::resize(int width, int height)
+{
+    Event e = {Event::RESIZE, width, height, 0, 0};
+    send(e);
+}
+
+//
+// apply one event on the simulating thread
+//
+void Simulation::apply(const Event &event)
+{
+    switch (event.type) {
+    case Event::KEY_PRESS:
+        input.keyPress(event.a);
+        break;
+    case Event::KEY_RELEASE:
+        input.keyRelease(event.a);
+        break;
+    case Event::MOUSE_BUTTON:
+        input.mousePress(event.a, event.b);
+        break;
+    case Event::MOUSE_MOVE:
+        input.mouseMove(scene, event.x, event.y);
+        break;
+    case Event::RESIZE:
+        // only used to scale mouse motion; the render thread owns the
+        // GL viewport
+        scene.width = event.a;
+        scene.height = event.b;
+        break;
+    }
+}
+
+//
+// one simulation update: events, fixed steps, and a new snapshot if the
+// view or whether it is moving changed
+//
+void Simulation::simulate(double now)
+{
+    Event event;
+    while (events.pop(event))
+        apply(event);
+
+    input.keyUpdate(scene, terrain, now);
+
+    bool active = input.active();
+    if (input.redraw || active != published) {
+        Snapshot &snap = snapshots.write();
+        snap.viewSph = scene.viewSph;
+        snap.positionSph = scene.positionSph;
+        snap.alignmentSph = scene.alignmentSph;
+        snap.active = active;
+        snapshots.publish();
+        input.redraw = false;
+        published = active;
+
+        // wake the render thread if it is waiting for events
+        if (thread && win)
+            glfwPostEmptyEvent();
+    }
+}
+
+//
+// simulation thread: update, then sleep until the next update is due
+// or an event arrives
+//
+void Simulation::run()
+{
+    CpuProfiler::nameThread("simulation");
+    while (! quit) {
+        simulate(FramePacer::time());
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping.store(true, std::memory_order_relaxed);
+
+        // pairs with the fence in send
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (events.empty() && ! quit) {
+            if (published)
+                wake.wait_for(lock, std::chrono::duration<double>(ACTIVE_WAIT));
+            else
+                wake.wait(lock);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+//
+// take the newest snapshot for drawing
+//
+bool Simulation::update(Scene &render, double now)
+{
+    if (! thread)
+        simulate(now);
+
+    if (! snapshots.update())
+        return false;
+
+    const Snapshot &snap = snapshots.read();
+    render.viewSph = snap.viewSph;
+    render.positionSph = snap.positionSph;
+    render.alignmentSph = snap.alignmentSph;
+    render.view();
+    return true;
+}
@@ -0,0 +1,131 @@
+// run input handling and movement apart from drawing
+#ifndef Simulation_hpp
+#define Simulation_hpp
+
+#include "Input.hpp"
+#include "Scene.hpp"
+#include "SpscQueue.hpp"
+#include "TripleBuffer.hpp"
+#include "Vec.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class Terrain;
+struct GLFWwindow;
+
+// Moves the point of view on a simulation thread, so a draw or a
+// buffer swap blocked on vsync never holds up input, and input never
+// holds up drawing.
+//
+// Threads and ownership:
+//   main (render) thread: GLFW events, GL calls, swap, and the Scene
+//     that is drawn. Never touches Input.
+//   simulation thread: Input and its own copy of the Scene view
+//     parameters. Reads the Terrain mesh through getElevation, which
+//     only reads data that is fixed after loading.
+//
+// Data flow, all without locks:
+//   main -> simulation: GLFW events go into a single producer, single
+//     consumer ring (SpscQueue). Pushing is one release store.
+//   simulation -> main: each change of view is written into a
+//     TripleBuffer of Snapshots and published with one atomic
+//     exchange. The render thread takes the newest snapshot at the
+//     start of each frame with another exchange, and never sees a
+//     partly written one. Snapshots it was too slow to draw are simply
+//     skipped.
+// Neither thread ever waits for the other on the way through a frame.
+//
+// Sleeping: while anything moves, the simulation wakes at a fixed rate
+// several times the display rate, so the newest snapshot is never more
+// than a few ms old. When nothing moves it blocks on a condition
+// variable. The mutex is only taken to go to sleep and, by the main
+// thread, to wake a thread that said it was sleeping; on the hot path
+// (simulation awake) an event costs one push and one atomic load. A
+// fence on each side of the sleeping flag makes sure an event pushed
+// just as the thread goes to sleep is either seen by its last check of
+// the queue or followed by a notify. After publishing, the simulation
+// posts an empty GLFW event to wake the render thread from its wait.
+//
+// Synchronous mode runs exactly the same steps inline in update(),
+// for deterministic input record and replay, or for comparison.
+class Simulation {
+// private data
+private:
+    // view handed to the render thread
+    struct Snapshot {
+        Vec3f viewSph;          // Scene::viewSph
+        Vec3f positionSph;      // Scene::positionSph
+        Vec2f alignmentSph;     // Scene::alignmentSph
+        bool active;            // still moving: keep drawing frames
+    };
+
+    // GLFW event forwarded to the simulation
+    struct Event {
+        enum Type {KEY_PRESS, KEY_RELEASE, MOUSE_BUTTON, MOUSE_MOVE, RESIZE};
+        Type type;
+        int a, b;               // key, button and action, or size
+        double x, y;            // mouse position
+    };
+
+    Input input;                // only used by the simulating thread
+    Scene scene;                // simulation's copy of the view
+    const Terrain &terrain;     // ground to walk on
+    GLFWwindow *win;            // window to wake for new snapshots
+
+    SpscQueue<Event, 1024> events;      // main to simulation
+    TripleBuffer<Snapshot> snapshots;   // simulation to main
+    bool published;             // active flag of last published snapshot
+
+    std::thread *thread;        // simulation thread, null if synchronous
+    std::mutex sleepMutex;      // only held to sleep or wake
+    std::condition_variable wake;
+    std::atomic<bool> sleeping; // simulation thread is (about to be) asleep
+    std::atomic<bool> quit;     // simulation thread should exit
+
+// private methods
+private:
+    // pass event on, to the queue or straight to Input
+    void send(const Event &event);
+
+    // apply one event to Input
+    void apply(const Event &event);
+
+    // take queued events, simulate to time now, and publish any change
+    void simulate(double now);
+
+    // simulation thread main loop
+    void run();
+
+// public methods
+public:
+    // start from the view in scene. With threaded, simulate on a new
+    // thread, waking win when there is something new to draw
+    Simulation(const Scene &scene, const Terrain &terrain,
+               GLFWwindow *win, bool threaded);
+
+    // stop the simulation thread
+    ~Simulation();
+
+    // running on its own thread?
+    bool threaded() const { return thread != 0; }
+
+    // forward input events
+    void keyPress(int key);
+    void keyRelease(int key);
+    void mouseButton(int button, int action);
+    void mouseMove(double x, double y);
+    void resize(int width, int height);
+
+    // render thread, once per frame: copy the newest view into scene,
+    // returning true if it changed. When synchronous, first simulate
+    // up to time now (in seconds); threaded uses its own clock.
+    bool update(Scene &scene, double now);
+
+    // render thread: is the view still moving as of the last update?
+    bool active() const { return snapshots.read().active; }
+};
+
+#endif
@@ -0,0 +1,60 @@
+// fixed-size queue from one thread to another, without locking
+#ifndef SpscQueue_hpp
+#define SpscQueue_hpp
+
+#include <atomic>
+
+// Single producer, single consumer ring of SIZE entries (a power of
+// two). The producer only writes tail and the consumer only writes
+// head, each publishing with a release store that the other side reads
+// with acquire, so an entry is always complete before it can be seen.
+// Counters run freely and wrap; their difference is the fill level.
+// head and tail are padded onto separate cache lines so the two threads
+// don't keep stealing one line from each other.
+template <typename T, unsigned int SIZE>
+class SpscQueue {
+// private data
+private:
+    enum {MASK = SIZE - 1};
+    static_assert((SIZE & MASK) == 0, "SpscQueue size must be a power of 2");
+
+    T entry[SIZE];
+    std::atomic<unsigned int> head;     // next to pop
+    char pad[64];                       // keep head and tail apart
+    std::atomic<unsigned int> tail;     // next to push
+
+// public methods
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // producer: add value, returning false if full
+    bool push(const T &value)
+    {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == SIZE)
+            return false;
+        entry[t & MASK] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer: take oldest value, returning false if empty
+    bool pop(T &value)
+    {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = entry[h & MASK];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // either side: true if nothing is waiting
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire)
+            == tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif
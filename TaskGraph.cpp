@@ -0,0 +1,310 @@
+// run a set of dependent tasks across worker threads and the GL thread
+
+#include "TaskGraph.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+    // seconds since some fixed time
+    double seconds()
+    {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+//
+// empty graph
+//
+TaskGraph::TaskGraph()
+    : queues(0), numWorkers(0), nextQueue(0),
+      queued(0), mainQueued(0), finished(0), startTime(0), runTime(0)
+{
+}
+
+//
+// free tasks
+//
+TaskGraph::~TaskGraph()
+{
+    for(unsigned int i=0; i<tasks.size(); ++i)
+        delete tasks[i];
+    delete[] queues;
+}
+
+//
+// add a task with no dependencies yet
+//
+unsigned int TaskGraph::add(const char *name, std::function<void()> work,
+                            Thread thread)
+{
+    Task *task = new Task;
+    task->name = name;
+    task->work = work;
+    task->thread = thread;
+    task->waiting = 0;
+    task->start = task->end = 0;
+    task->ranOn = 0;
+    tasks.push_back(task);
+    return (unsigned int)(tasks.size() - 1);
+}
+
+//
+// record a dependency in both directions: dependents to start tasks,
+// dependencies for the critical path
+//
+void TaskGraph::depend(unsigned int task, unsigned int before)
+{
+    tasks[task]->dependencies.push_back(before);
+    tasks[before]->dependents.push_back(task);
+}
+
+//
+// put ready task on a queue and wake someone to take it. Workers keep
+// what they free up; the main thread spreads its tasks round robin.
+//
+void TaskGraph::schedule(unsigned int id, unsigned int thread)
+{
+    if (tasks[id]->thread == MAIN_THREAD || numWorkers == 0) {
+        {
+            std::lock_guard<std::mutex> lock(queues[0].lock);
+            queues[0].ids.push_back(id);
+        }
+        ++mainQueued;
+        std::lock_guard<std::mutex> lock(sleepLock);
+        mainReady.notify_one();
+        return;
+    }
+
+    unsigned int q = thread;
+    if (q == 0)
+        q = 1 + nextQueue++ % numWorkers;
+    {
+        std::lock_guard<std::mutex> lock(queues[q].lock);
+        queues[q].ids.push_back(id);
+    }
+    ++queued;
+    std::lock_guard<std::mutex> lock(sleepLock);
+    workReady.notify_one();
+}
+
+//
+// main thread takes its tasks in order. Workers take the newest of
+// their own, or steal the oldest of someone else's.
+//
+bool TaskGraph::take(unsigned int thread, unsigned int &id)
+{
+    if (thread == 0) {
+        std::lock_guard<std::mutex> lock(queues[0].lock);
+        if (queues[0].ids.empty()) return false;
+        id = queues[0].ids.front();
+        queues[0].ids.pop_front();
+        --mainQueued;
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[thread].lock);
+        if (! queues[thread].ids.empty()) {
+            id = queues[thread].ids.back();
+            queues[thread].ids.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for(unsigned int i=1; i<numWorkers; ++i) {
+        Queue &victim = queues[1 + (thread - 1 + i) % numWorkers];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (! victim.ids.empty()) {
+            id = victim.ids.front();
+            victim.ids.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// run one task, and release any that were waiting only for it
+//
+void TaskGraph::execute(unsigned int id, unsigned int thread)
+{
+    Task *task = tasks[id];
+    task->ranOn = thread;
+    task->start = seconds() - startTime;
+    {
+        CpuProfiler::Zone zone(task->name);
+        task->work();
+    }
+    task->end = seconds() - startTime;
+
+    for(unsigned int i=0; i<task->dependents.size(); ++i) {
+        unsigned int next = task->dependents[i];
+        if (--tasks[next]->waiting == 0)
+            schedule(next, thread);
+    }
+
+    // last one out wakes everyone to finish
+    if (++finished == tasks.size()) {
+        std::lock_guard<std::mutex> lock(sleepLock);
+        workReady.notify_all();
+        mainReady.notify_all();
+    }
+}
+
+//
+// worker: run tasks until all are done, sleeping when there are none
+//
+void TaskGraph::work(unsigned int thread)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "startup worker %u", thread);
+    CpuProfiler::nameThread(name);
+
+    for(;;) {
+        unsigned int id;
+        if (take(thread, id)) {
+            execute(id, thread);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepLock);
+        if (finished == tasks.size())
+            break;
+        if (queued == 0)
+            workReady.wait(lock);
+    }
+}
+
+//
+// check for loops, then run everything
+//
+bool TaskGraph::run(unsigned int workers)
+{
+    // count tasks that can ever start (Kahn's algorithm)
+    std::vector<unsigned int> waiting(tasks.size()), ready;
+    for(unsigned int i=0; i<tasks.size(); ++i) {
+        waiting[i] = (unsigned int)tasks[i]->dependencies.size();
+        if (waiting[i] == 0) ready.push_back(i);
+    }
+    for(unsigned int r=0; r<ready.size(); ++r) {
+        const std::vector<unsigned int> &next = tasks[ready[r]]->dependents;
+        for(unsigned int i=0; i<next.size(); ++i)
+            if (--waiting[next[i]] == 0) ready.push_back(next[i]);
+    }
+    if (ready.size() != tasks.size()) {
+        for(unsigned int i=0; i<tasks.size(); ++i)
+            if (waiting[i])
+                fprintf(stderr, "task graph: \"%s\" waits on a "
+                        "dependency loop\n", tasks[i]->name);
+        return false;
+    }
+
+    // start with everything that depends on nothing
+    delete[] queues;
+    numWorkers = workers;
+    queues = new Queue[numWorkers + 1];
+    queued = mainQueued = finished = 0;
+    for(unsigned int i=0; i<tasks.size(); ++i)
+        tasks[i]->waiting = (unsigned int)tasks[i]->dependencies.size();
+    startTime = seconds();
+    for(unsigned int i=0; i<tasks.size(); ++i)
+        if (tasks[i]->waiting == 0)
+            schedule(i, 0);
+
+    std::vector<std::thread> pool;
+    for(unsigned int w=1; w<=numWorkers; ++w)
+        pool.push_back(std::thread(&TaskGraph::work, this, w));
+
+    // main thread: run main thread tasks as they become ready
+    while (finished < tasks.size()) {
+        unsigned int id;
+        if (take(0, id)) {
+            execute(id, 0);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepLock);
+        if (finished < tasks.size() && mainQueued == 0)
+            mainReady.wait(lock);
+    }
+
+    for(unsigned int w=0; w<pool.size(); ++w)
+        pool[w].join();
+    runTime = seconds() - startTime;
+    return true;
+}
+
+//
+// timeline in start order, then the critical path back from the last
+// task. Each step goes to whatever finished last of the task's
+// dependencies and the task before it on the same thread, since
+// either could have held it up.
+//
+void TaskGraph::dump(FILE *out) const
+{
+    std::vector<unsigned int> order(tasks.size());
+    for(unsigned int i=0; i<tasks.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [this](unsigned int a, unsigned int b) {
+                  return tasks[a]->start < tasks[b]->start;
+              });
+
+    fprintf(out, "%u tasks in %.1f ms with %u worker threads\n",
+            (unsigned int)tasks.size(), 1000*runTime, numWorkers);
+    fprintf(out, "   start(ms)  end(ms)  thread    task\n");
+    for(unsigned int i=0; i<order.size(); ++i) {
+        const Task *task = tasks[order[i]];
+        char thread[24];
+        if (task->ranOn == 0)
+            snprintf(thread, sizeof(thread), "main");
+        else
+            snprintf(thread, sizeof(thread), "worker %u", task->ranOn);
+        fprintf(out, "  %9.1f %9.1f  %-8s  %s\n",
+                1000*task->start, 1000*task->end, thread, task->name);
+    }
+
+    if (tasks.empty()) return;
+    unsigned int last = 0;
+    for(unsigned int i=1; i<tasks.size(); ++i)
+        if (tasks[i]->end > tasks[last]->end) last = i;
+    std::vector<unsigned int> path(1, last);
+    for(;;) {
+        const Task *task = tasks[path.back()];
+        int latest = -1;
+        double latestEnd = -1;
+        for(unsigned int i=0; i<task->dependencies.size(); ++i) {
+            const Task *dep = tasks[task->dependencies[i]];
+            if (dep->end > latestEnd) {
+                latest = int(task->dependencies[i]);
+                latestEnd = dep->end;
+            }
+        }
+        for(unsigned int i=0; i<tasks.size(); ++i) {
+            const Task *other = tasks[i];
+            if (other != task && other->ranOn == task->ranOn
+                && other->end <= task->start && other->end > latestEnd) {
+                latest = int(i);
+                latestEnd = other->end;
+            }
+        }
+        if (latest < 0) break;
+        path.push_back((unsigned int)latest);
+    }
+
+    double busy = 0;
+    fprintf(out, "critical path:");
+    for(unsigned int i=(unsigned int)path.size(); i-- > 0; ) {
+        const Task *task = tasks[path[i]];
+        busy += task->end - task->start;
+        fprintf(out, " %s (%.1f)%s", task->name,
+                1000*(task->end - task->start), i ? " ->" : "\n");
+    }
+    fprintf(out, "  %.1f ms running, %.1f ms waiting to start\n",
+            1000*busy, 1000*(tasks[last]->end - busy));
+}
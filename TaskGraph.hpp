@@ -0,0 +1,98 @@
+// run a set of dependent tasks across worker threads and the GL thread
+#ifndef TaskGraph_hpp
+#define TaskGraph_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+// Tasks are added with the work to do and whether it must run on the
+// main thread (anything making GL calls), then linked with depend().
+// run() starts a pool of workers and runs every task once all of its
+// dependencies are done. Each worker has its own queue: it takes the
+// newest task from its own queue, and when that is empty steals the
+// oldest from another's, so a worker that frees up a chain of tasks
+// keeps its data in cache while idle workers spread the load.
+// Main-thread tasks go into a separate queue that only the caller of
+// run() takes from. With no workers, the main thread runs everything.
+// Start and end times of each task are kept for dump(), which also
+// shows the critical path: the chain of tasks that set the total time,
+// each held up by a dependency or by waiting its turn on a thread.
+class TaskGraph {
+// public constants
+public:
+    enum Thread {ANY_THREAD, MAIN_THREAD};
+
+// private data
+private:
+    struct Task {
+        const char *name;       // for the timeline
+        std::function<void()> work;
+        Thread thread;          // where it may run
+        std::vector<unsigned int> dependencies; // tasks to finish first
+        std::vector<unsigned int> dependents;   // tasks waiting for this
+        std::atomic<unsigned int> waiting;      // unfinished dependencies
+        double start, end;      // seconds since run started
+        unsigned int ranOn;     // 0 for main thread, else worker number
+    };
+    std::vector<Task*> tasks;
+
+    // queue 0 is for the main thread, then one per worker
+    struct Queue {
+        std::mutex lock;
+        std::deque<unsigned int> ids;
+    };
+    Queue *queues;
+    unsigned int numWorkers;
+    unsigned int nextQueue;     // round robin for tasks from the main thread
+
+    // sleeping when there is nothing to take
+    std::mutex sleepLock;
+    std::condition_variable workReady, mainReady;
+    std::atomic<unsigned int> queued;       // tasks in worker queues
+    std::atomic<unsigned int> mainQueued;   // tasks in main thread queue
+    std::atomic<unsigned int> finished;     // tasks done
+
+    double startTime;           // when run started
+    double runTime;             // seconds for the whole run
+
+// private methods
+private:
+    // queue a task whose dependencies are done, from thread
+    void schedule(unsigned int id, unsigned int thread);
+
+    // take a task for thread, returning false if there is none
+    bool take(unsigned int thread, unsigned int &id);
+
+    // run task on thread, then schedule anything it was holding up
+    void execute(unsigned int id, unsigned int thread);
+
+    // worker thread main loop
+    void work(unsigned int thread);
+
+// public methods
+public:
+    TaskGraph();
+    ~TaskGraph();
+
+    // add a task, returning its id for depend()
+    unsigned int add(const char *name, std::function<void()> work,
+                     Thread thread = ANY_THREAD);
+
+    // task won't start until before has finished
+    void depend(unsigned int task, unsigned int before);
+
+    // run every task with workers extra threads, returning when all are
+    // done. Returns false without running anything if the dependencies
+    // loop.
+    bool run(unsigned int workers);
+
+    // print when and where each task ran, and the critical path
+    void dump(FILE *out) const;
+};
+
+#endif
@@ -1,8 +1,17 @@
 // draw a simple terrain height field
 
 #include "Terrain.hpp"
+#include "TaskGraph.hpp"
+#include "FrameScheduler.hpp"
+#include "FramePacer.hpp"
+#include "CpuProfiler.hpp"
+#include "Metrics.hpp"
+#include "MemoryTracker.hpp"
+#include "GLState.hpp"
 #include "AppContext.hpp"
 #include "ImagePPM.hpp"
+#include "Hash.hpp"
+#include "Vec3fArray.hpp"
 #include "Vec.inl"
 #include "math.h"
 
@@ -10,46 +19,270 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#else
+#include <sys/mman.h>
+#endif
+
+
+// mesh cache file format: header followed by the raw vert, dPdu,
+// dPdv, norm, texcoord and indices arrays. Bump the version whenever
+// the mesh generation or this layout changes.
+namespace {
+    const char MESH_CACHE_MAGIC[4] = {'T','M','S','H'};
+    const unsigned int MESH_CACHE_VERSION = 2;
+
+    struct MeshCacheHeader {
+        char magic[4];          // MESH_CACHE_MAGIC
+        unsigned int version;   // MESH_CACHE_VERSION
+        unsigned long long key; // hash of mesh inputs
+        unsigned int width, height; // replicated grid size
+        unsigned int numvert, numtri;
+    };
+
+    // total cache file size for a mesh of this size
+    unsigned long meshCacheSize(unsigned int numvert, unsigned int numtri)
+    {
+        return sizeof(MeshCacheHeader)
+            + numvert * (4*sizeof(Vec3f) + sizeof(Vec2f))
+            + numtri * sizeof(Vec<unsigned int, 3>);
+    }
+
+    // shader #defines for each combination of Terrain::*_FEATURE flags
+    const char *const variantDefines[Terrain::NUM_VARIANTS] = {
+        "",
+        "#define FOG 1\n",
+        "#define NORMAL_MAP 1\n",
+        "#define FOG 1\n#define NORMAL_MAP 1\n"
+    };
+
+    // texel of image at x,y in a width x height layer, nearest texel
+    // if the image is a different size
+    Vec3c sample(const ImagePPM &image, unsigned int x, unsigned int y,
+                 unsigned int width, unsigned int height)
+    {
+        return image(x * image.width / width, y * image.height / height);
+    }
+}
 
 //
-// load the terrain data
+// set up GL objects; load() adds the tasks that fill them
 //
 Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
-                 const char *normalPPM, const char *glossPPM)
+                 const char *normalPPM, const char *glossPPM,
+                 const char *meshCache)
+    : numvert(0), vert(0), dPdu(0), dPdv(0), norm(0), texcoord(0),
+      numtri(0), indices(0), meshMap(0), meshMapSize(0),
+      elevationFile(elevationPPM), meshCacheFile(meshCache),
+      layers(0), layerWidth(0), layerHeight(0),
+      meshTime(0), meshCached(false), features(NORMALMAP_FEATURE),
+      scheduler(0)
 {
 	// set amount of terrain replication
 	repl = 3;
 
+    // world dimensions
+	walkableSize = vec2<float>(512, 512);
+    mapSize = vec3<float>(walkableSize.x*repl, walkableSize.y*repl, 50);
+
     // buffer objects to be used later
     glGenTextures(NUM_TEXTURES, textureIDs);
     glGenBuffers(NUM_BUFFERS, bufferIDs);
     glGenVertexArrays(NUM_VARRAYS, varrayIDs);
 
-    // load albedo, normal & gloss image into a named textures
-    ImagePPM(texturePPM).loadTexture(textureIDs[COLOR_TEXTURE]);
-    ImagePPM(normalPPM).loadTexture(textureIDs[NORMAL_TEXTURE]);
-    ImagePPM(glossPPM).loadTexture(textureIDs[GLOSS_TEXTURE]);
+    imageFiles[COLOR_IMAGE] = texturePPM;
+    imageFiles[NORMAL_IMAGE] = normalPPM;
+    imageFiles[GLOSS_IMAGE] = glossPPM;
+    for(unsigned int i=0; i<NUM_IMAGES; ++i) {
+        images[i] = 0;
+        textureJobs[i] = 0;
+    }
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        shaderIDs[v] = 0;
+        shaderJobs[v] = 0;
+    }
+}
+
+//
+// Reading images and building the mesh only touch memory, so they can
+// run on any thread. Uploads and shader builds make GL calls, so run
+// on the main thread, with shader compiles started first to overlap
+// everything else.
+//
+unsigned int Terrain::load(TaskGraph &graph)
+{
+    static const char *const decodeNames[NUM_IMAGES] = {
+        "decode color map", "decode normal map", "decode gloss map"
+    };
+
+    unsigned int ready = graph.add("terrain ready", []{},
+                                   TaskGraph::MAIN_THREAD);
+
+    // initial shader load, started before anything else
+    unsigned int start = graph.add("start terrain shaders",
+                                   [this]{ startShaderBuilds(); },
+                                   TaskGraph::MAIN_THREAD);
+    unsigned int finish = graph.add("link terrain shaders",
+                                    [this]{ finishShaderBuilds(); },
+                                    TaskGraph::MAIN_THREAD);
+    graph.depend(finish, start);
+    graph.depend(ready, finish);
+
+    // albedo, normal & gloss images packed into texture array layers
+    unsigned int pack = graph.add("pack surface layers", [this]{
+            layerWidth = images[COLOR_IMAGE]->width;
+            layerHeight = images[COLOR_IMAGE]->height;
+            layers = MemoryTracker::allocate<Vec4c>(MemoryTracker::IMAGES,
+                NUM_LAYERS * layerWidth * layerHeight);
+            packLayers(0, NUM_LAYERS);
+        });
+    for(unsigned int i=0; i<NUM_IMAGES; ++i) {
+        unsigned int decode = graph.add(decodeNames[i], [this, i]{
+                images[i] = new ImagePPM(imageFiles[i].c_str());
+            });
+        graph.depend(pack, decode);
+    }
+    unsigned int textures = graph.add("upload surface layers", [this]{
+            uploadLayers(0, NUM_LAYERS);
+        }, TaskGraph::MAIN_THREAD);
+    graph.depend(textures, pack);
+    graph.depend(ready, textures);
+
+    // mesh from cache or elevation image, then to the GPU
+    unsigned int mesh = graph.add("terrain mesh", [this]{ loadMesh(); });
+    unsigned int upload = graph.add("upload terrain mesh",
+                                    [this]{ uploadMesh(); },
+                                    TaskGraph::MAIN_THREAD);
+    graph.depend(upload, mesh);
+    graph.depend(ready, upload);
+
+    return ready;
+}
+
+//
+// use cached mesh if current, otherwise build and save a new one
+//
+void Terrain::loadMesh()
+{
+    // cache key covers the elevation data and every mesh parameter
+    double startTime = FramePacer::time();
+    // an unreadable elevation file has no hash, so skip the cache
+    unsigned long long key = hashFile(elevationFile);
+    bool useCache = meshCacheFile && key != 0;
+    key = hashBytes(&repl, sizeof(repl), key);
+    key = hashBytes(&mapSize, sizeof(mapSize), key);
+    key = hashBytes(&walkableSize, sizeof(walkableSize), key);
+
+    meshCached = useCache && loadMeshCache(meshCacheFile, key);
+    if (! meshCached) {
+        buildMesh(ImagePPM(elevationFile));
+        if (useCache)
+            writeMeshCache(meshCacheFile, key);
+    }
+    meshTime = FramePacer::time() - startTime;
+    fprintf(stderr, "terrain mesh %s in %.1f ms\n",
+            meshCached ? "loaded from cache" : "built", 1000*meshTime);
+}
+
+//
+// load vertex and index array to GPU
+//
+void Terrain::uploadMesh()
+{
+    // element buffer binding is part of the vertex array
+    GLState::bindVertexArray(varrayIDs[TERRAIN_VARRAY]);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), vert, GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), dPdu, GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), dPdv, GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), norm, GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec2f), texcoord, 
+                 GL_STATIC_DRAW);
+
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
+                 numtri*sizeof(unsigned int[3]), indices, GL_STATIC_DRAW);
+
+    for(int i=POSITION_BUFFER; i<=NORMAL_BUFFER; ++i)
+        MemoryTracker::bufferData(MemoryTracker::MESH, bufferIDs[i],
+                                  numvert*sizeof(Vec3f));
+    MemoryTracker::bufferData(MemoryTracker::MESH, bufferIDs[UV_BUFFER],
+                              numvert*sizeof(Vec2f));
+    MemoryTracker::bufferData(MemoryTracker::MESH, bufferIDs[INDEX_BUFFER],
+                              numtri*sizeof(unsigned int[3]));
+
+    // connect attribute arrays: shader locations match buffer order
+    for(int i=POSITION_BUFFER; i<=UV_BUFFER; ++i) {
+        GLState::bindBuffer(GL_ARRAY_BUFFER, bufferIDs[i]);
+        glVertexAttribPointer(i, i==UV_BUFFER ? 2 : 3, GL_FLOAT, GL_FALSE,
+                              0, 0);
+        glEnableVertexAttribArray(i);
+    }
+}
+
+//
+// start every variant before waiting so they can compile in parallel
+//
+void Terrain::startShaderBuilds()
+{
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        shaderParts[v][0].type = GL_VERTEX_SHADER;
+        shaderParts[v][0].file = "terrain.vert";
+        shaderParts[v][0].defines = variantDefines[v];
+        shaderParts[v][1].type = GL_FRAGMENT_SHADER;
+        shaderParts[v][1].file = "terrain.frag";
+        shaderParts[v][1].defines = variantDefines[v];
+        startShaders(shaderBuilds[v], 2, shaderParts[v]);
+    }
+}
 
-    // load terrain heights
-    ImagePPM elevation(elevationPPM);
+//
+// wait for initial shaders and connect their parameters
+//
+void Terrain::finishShaderBuilds()
+{
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        ::pollShaders(shaderBuilds[v], true, shaderIDs[v]);
+        bindProgram(v);
+    }
+}
+
+//
+// build vertex, normal, texture coordinate and index arrays
+//
+void Terrain::buildMesh(const ImagePPM &elevation)
+{
+    // terrain size from elevation image
     unsigned int w_act = elevation.width, h_act = elevation.height;
 	unsigned int w = w_act*repl, h = h_act*repl;
     gridSize = vec3<float>(float(w), float(h), 255.f);
 
-    // world dimensions
-	walkableSize = vec2<float>(512, 512);
-    mapSize = vec3<float>(walkableSize.x*repl, walkableSize.y*repl, 50);
-
     // build vertex, normal and texture coordinate arrays
     // * x & y are the position in the terrain grid
     // * idx is the linear array index for each vertex
     numvert = (w + 1) * (h + 1);
-    vert = new Vec3f[numvert];
-    dPdu = new Vec3f[numvert];
-    dPdv = new Vec3f[numvert];
-    norm = new Vec3f[numvert];
-    texcoord = new Vec2f[numvert];
+    vert = MemoryTracker::allocate<Vec3f>(MemoryTracker::MESH, numvert);
+    dPdu = MemoryTracker::allocate<Vec3f>(MemoryTracker::MESH, numvert);
+    dPdv = MemoryTracker::allocate<Vec3f>(MemoryTracker::MESH, numvert);
+    norm = MemoryTracker::allocate<Vec3f>(MemoryTracker::MESH, numvert);
+    texcoord = MemoryTracker::allocate<Vec2f>(MemoryTracker::MESH, numvert);
 
+    Vec3fArray rowU, rowV;      // one row of tangents, for bulk normals
     for(unsigned int y=0, idx=0;  y <= h;  ++y) {
         for(unsigned int x=0;  x <= w;  ++idx, ++x) {
 			// 3d vertex location: x,y from grid location, z from terrain data
@@ -78,14 +311,21 @@ Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
 			float dv = (elevation(x%w_act, (y+1)%h_act).r - elevation(x%w_act, (y+h-1)%h_act).r)
 				* 0.5f * mapSize.z / gridSize.z;
 
-			// final tangents and normal using these
+			// final tangents using these, normals after the row
 			dPdu[idx] = normalize(vec3<float>(mapSize.x/gridSize.x, 0, du));
 			dPdv[idx] = normalize(vec3<float>(0, mapSize.y/gridSize.y, dv));
-			norm[idx] = normalize(dPdu[idx] ^ dPdv[idx]);
 
 			// 2D texture coordinate for rocks texture, from grid location
 			texcoord[idx] = vec2<float>(float(x*repl),float(y*repl)) / gridSize.xy;
         }
+
+        // normals for the whole row are the cross product of the tangents
+        unsigned int row = y*(w+1);
+        rowU.load(dPdu + row, w+1);
+        rowV.load(dPdv + row, w+1);
+        cross(rowU, rowV, rowU);
+        normalize(rowU, rowU);
+        rowU.store(norm + row);
     }
 
     // build index array linking sets of three vertices into triangles
@@ -93,7 +333,8 @@ Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
     // essentially its unfolded grid array position. Be careful that
     // each triangle ends up in counter-clockwise order
     numtri = 2*w*h;
-    indices = new Vec<unsigned int, 3>[numtri];
+    indices = MemoryTracker::allocate< Vec<unsigned int, 3> >(
+        MemoryTracker::MESH, numtri);
     for(unsigned int y=0, idx=0; y<h; ++y) {
         for(unsigned int x=0; x<w; ++x, idx+=2) {
             indices[idx][0] = (w+1)* y    + x;
@@ -105,83 +346,309 @@ Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
             indices[idx+1][2] = (w+1)*(y+1) + x;
         }
     }
+}
 
-    // load vertex and index array to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), vert, GL_STATIC_DRAW);
+//
+// map mesh arrays from cache file if its key matches
+//
+bool Terrain::loadMeshCache(const char *cacheFile, unsigned long long key)
+{
+    // read just the header first to check it is current
+    FILE *fp = fopen(cacheFile, "rb");
+    if (!fp) return false;
+
+    MeshCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, fp) == 1
+        && memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == MESH_CACHE_VERSION
+        && header.key == key;
+
+    unsigned long size = 0;
+    if (valid) {
+        size = meshCacheSize(header.numvert, header.numtri);
+        fseek(fp, 0, SEEK_END);
+        valid = (unsigned long)ftell(fp) == size;
+    }
+    if (! valid) {
+        fclose(fp);
+        return false;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), dPdu, GL_STATIC_DRAW);
+#ifdef _WIN32
+    // no mmap: read the whole file into memory instead
+    char *data = new char[size];
+    fseek(fp, 0, SEEK_SET);
+    valid = fread(data, 1, size, fp) == size;
+    fclose(fp);
+    if (! valid) {
+        delete[] data;
+        return false;
+    }
+#else
+    // map file read-only; arrays are used directly from the mapping
+    char *data = (char*)mmap(0, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    if (data == MAP_FAILED)
+        return false;
+#endif
+    meshMap = data;
+    meshMapSize = size;
+    MemoryTracker::add(MemoryTracker::MESH, MemoryTracker::CPU, size);
+
+    // point arrays into the file
+    numvert = header.numvert;
+    numtri = header.numtri;
+    gridSize = vec3<float>(float(header.width), float(header.height), 255.f);
+    data += sizeof(MeshCacheHeader);
+    vert = (Vec3f*)data;                data += numvert*sizeof(Vec3f);
+    dPdu = (Vec3f*)data;                data += numvert*sizeof(Vec3f);
+    dPdv = (Vec3f*)data;                data += numvert*sizeof(Vec3f);
+    norm = (Vec3f*)data;                data += numvert*sizeof(Vec3f);
+    texcoord = (Vec2f*)data;            data += numvert*sizeof(Vec2f);
+    indices = (Vec<unsigned int, 3>*)data;
+
+    return true;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), dPdv, GL_STATIC_DRAW);
+//
+// save mesh arrays to cache file
+// written to a temporary file first so a partial write is never used
+//
+void Terrain::writeMeshCache(const char *cacheFile, unsigned long long key) const
+{
+    char tmpFile[1024];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", cacheFile);
+    FILE *fp = fopen(tmpFile, "wb");
+    if (!fp) {
+        fprintf(stderr, "unable to write mesh cache %s\n", tmpFile);
+        return;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec3f), norm, GL_STATIC_DRAW);
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.key = key;
+    header.width = (unsigned int)gridSize.x;
+    header.height = (unsigned int)gridSize.y;
+    header.numvert = numvert;
+    header.numtri = numtri;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(vert, sizeof(Vec3f), numvert, fp) == numvert
+        && fwrite(dPdu, sizeof(Vec3f), numvert, fp) == numvert
+        && fwrite(dPdv, sizeof(Vec3f), numvert, fp) == numvert
+        && fwrite(norm, sizeof(Vec3f), numvert, fp) == numvert
+        && fwrite(texcoord, sizeof(Vec2f), numvert, fp) == numvert
+        && fwrite(indices, sizeof(*indices), numtri, fp) == numtri;
+    ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+    remove(cacheFile);          // windows rename won't replace
+#endif
+    if (! ok || rename(tmpFile, cacheFile) != 0) {
+        fprintf(stderr, "unable to write mesh cache %s\n", cacheFile);
+        remove(tmpFile);
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(Vec2f), texcoord, 
-                 GL_STATIC_DRAW);
+//
+// Delete terrain data
+//
+Terrain::~Terrain()
+{
+    // waiting jobs would use this terrain
+    if (scheduler) {
+        for(unsigned int i=0; i<NUM_IMAGES; ++i)
+            scheduler->cancel(textureJobs[i]);
+        for(unsigned int v=0; v<NUM_VARIANTS; ++v)
+            scheduler->cancel(shaderJobs[v]);
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
-                 numtri*sizeof(unsigned int[3]), indices, GL_STATIC_DRAW);
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        cancelShaders(shaderBuilds[v]);
+        GLState::deleteProgram(shaderIDs[v]);
+    }
+    GLState::deleteTextures(NUM_TEXTURES, textureIDs);
+    GLState::deleteBuffers(NUM_BUFFERS, bufferIDs);
+    MemoryTracker::deleteTextures(NUM_TEXTURES, textureIDs);
+    MemoryTracker::deleteBuffers(NUM_BUFFERS, bufferIDs);
+    for(unsigned int i=0; i<NUM_IMAGES; ++i)
+        delete images[i];
+    MemoryTracker::release(MemoryTracker::IMAGES, layers,
+                           NUM_LAYERS * layerWidth * layerHeight);
+
+    // arrays either point into the cache mapping or were allocated
+    if (meshMap) {
+#ifdef _WIN32
+        delete[] (char*)meshMap;
+#else
+        munmap(meshMap, meshMapSize);
+#endif
+        MemoryTracker::remove(MemoryTracker::MESH, MemoryTracker::CPU,
+                              meshMapSize);
+        return;
+    }
+    MemoryTracker::release(MemoryTracker::MESH, indices, numtri);
+    MemoryTracker::release(MemoryTracker::MESH, texcoord, numvert);
+    MemoryTracker::release(MemoryTracker::MESH, norm, numvert);
+    MemoryTracker::release(MemoryTracker::MESH, dPdv, numvert);
+    MemoryTracker::release(MemoryTracker::MESH, dPdu, numvert);
+    MemoryTracker::release(MemoryTracker::MESH, vert, numvert);
+}
+
+//
+// pack source images into RGBA layers. Normal map x & y keep their
+// 0-255 encoding of -1 to 1, and z = sqrt(1 - x*x - y*y) is rebuilt in
+// the shader; gloss only ever used its first channel.
+//
+void Terrain::packLayers(unsigned int firstLayer, unsigned int numLayers)
+{
+    for(unsigned int l=firstLayer; l<firstLayer+numLayers; ++l) {
+        Vec4c *layer = layers + l * layerWidth * layerHeight;
+        for(unsigned int y=0; y<layerHeight; ++y) {
+            for(unsigned int x=0; x<layerWidth; ++x) {
+                Vec4c &texel = layer[y*layerWidth + x];
+                if (l == COLOR_LAYER) {
+                    texel.rgb = sample(*images[COLOR_IMAGE], x, y,
+                                       layerWidth, layerHeight);
+                }
+                else {
+                    texel.xy = sample(*images[NORMAL_IMAGE], x, y,
+                                      layerWidth, layerHeight).xy;
+                    texel.z = sample(*images[GLOSS_IMAGE], x, y,
+                                     layerWidth, layerHeight).x;
+                }
+                texel.w = 255;  // spare
+            }
+        }
+    }
+
+    // sources are no longer needed
+    for(unsigned int i=0; i<NUM_IMAGES; ++i) {
+        delete images[i];
+        images[i] = 0;
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+//
+// first upload allocates every layer, later ones replace some
+//
+void Terrain::uploadLayers(unsigned int firstLayer, unsigned int numLayers)
+{
+    unsigned int textureID = textureIDs[SURFACE_TEXTURE];
+    GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, textureID);
+    if (numLayers == NUM_LAYERS)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8,
+                     layerWidth, layerHeight, NUM_LAYERS, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, layers);
+    else
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, firstLayer,
+                        layerWidth, layerHeight, numLayers,
+                        GL_RGBA, GL_UNSIGNED_BYTE,
+                        layers + firstLayer * layerWidth * layerHeight);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    MemoryTracker::textureImage(MemoryTracker::TEXTURES, textureID,
+                                layerWidth, layerHeight, 4*NUM_LAYERS, true);
+    Metrics::textureBytes.add(4ull * layerWidth * layerHeight * numLayers);
 
-    // initial shader load
-    shaderParts[0].id = glCreateShader(GL_VERTEX_SHADER);
-    shaderParts[0].file = "terrain.vert";
-    shaderParts[1].id = glCreateShader(GL_FRAGMENT_SHADER);
-    shaderParts[1].file = "terrain.frag";
-    shaderID = glCreateProgram();
-    updateShaders();
+    MemoryTracker::release(MemoryTracker::IMAGES, layers,
+                           NUM_LAYERS * layerWidth * layerHeight);
+    layers = 0;
 }
 
 //
-// Delete terrain data
+// load (or replace) source image, between frames if there is a scheduler
+// a newer request for the same image replaces one still waiting
 //
-Terrain::~Terrain()
+void Terrain::updateTexture(const char *ppm, unsigned int image)
 {
-    glDeleteShader(shaderParts[0].id);
-    glDeleteShader(shaderParts[1].id);
-    glDeleteProgram(shaderID);
-    glDeleteTextures(NUM_TEXTURES, textureIDs);
-    glDeleteBuffers(NUM_BUFFERS, bufferIDs);
-
-    delete[] indices;
-    delete[] texcoord;
-    delete[] norm;
-    delete[] dPdv;
-    delete[] dPdu;
-    delete[] vert;
+    if (image >= NUM_IMAGES)
+        return;
+    if (! scheduler) {
+        replaceTexture(ppm, image);
+        return;
+    }
+
+    std::string file(ppm);
+    scheduler->cancel(textureJobs[image]);
+    textureJobs[image] = scheduler->add("terrain texture",
+                                        [this, file, image]{
+            replaceTexture(file.c_str(), image);
+        });
 }
 
 //
-// load (or replace) texture
+// load source image from file now, and repack the layer it is in
+// along with the other images in that layer
 //
-void Terrain::updateTexture(const char *ppm, unsigned int textureID)
+void Terrain::replaceTexture(const char *ppm, unsigned int image)
 {
-    ImagePPM texture(ppm);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 
-                 texture.width, texture.height, 0,
-                 GL_RGB, GL_UNSIGNED_BYTE, texture.image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    imageFiles[image] = ppm;
+    unsigned int layer = image == COLOR_IMAGE ? COLOR_LAYER : MATERIAL_LAYER;
+    for(unsigned int i=0; i<NUM_IMAGES; ++i)
+        if ((i == COLOR_IMAGE) == (layer == COLOR_LAYER))
+            images[i] = new ImagePPM(imageFiles[i].c_str());
+
+    layers = MemoryTracker::allocate<Vec4c>(MemoryTracker::IMAGES,
+        NUM_LAYERS * layerWidth * layerHeight);
+    packLayers(layer, 1);
+    uploadLayers(layer, 1);
 }
 
 //
-// load (or replace) terrain shaders
+// start loading replacement shaders for every variant
+// the current programs stay in use until the new ones link
+// with a scheduler, each variant starts between frames, and a request
+// still waiting there is replaced rather than repeated
 //
 void Terrain::updateShaders()
 {
-    loadShaders(shaderID, sizeof(shaderParts)/sizeof(*shaderParts), 
-                shaderParts);
-    glUseProgram(shaderID);
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        if (! scheduler) {
+            startShaders(shaderBuilds[v], 2, shaderParts[v]);
+            continue;
+        }
+
+        scheduler->cancel(shaderJobs[v]);
+        shaderJobs[v] = scheduler->add("terrain shaders", [this, v]{
+                startShaders(shaderBuilds[v], 2, shaderParts[v]);
+            }, FrameScheduler::HIGH);
+    }
+}
+
+//
+// swap in reloaded shaders if they are ready
+//
+bool Terrain::pollShaders()
+{
+    bool changed = false;
+    for(unsigned int v=0; v<NUM_VARIANTS; ++v) {
+        unsigned int newID;
+        if (::pollShaders(shaderBuilds[v], false, newID) != SHADER_READY)
+            continue;
+
+        GLState::deleteProgram(shaderIDs[v]);
+        shaderIDs[v] = newID;
+        bindProgram(v);
+        Metrics::shaderReloads.add();
+        changed = true;
+    }
+    return changed;
+}
+
+//
+// (re)connect shader parameters to current program for variant
+// attribute locations are fixed in the shader, so the vertex array
+// object doesn't need to change
+//
+void Terrain::bindProgram(unsigned int variant)
+{
+    unsigned int shaderID = shaderIDs[variant];
+    if (! shaderID)
+        return;                 // load failed
+    GLState::useProgram(shaderID);
 
     // (re)connect view and projection matrices
     glUniformBlockBinding(shaderID, 
@@ -189,42 +656,8 @@ void Terrain::updateShaders()
                           AppContext::SCENE_UNIFORMS);
 
     // map shader name for texture to glActiveTexture number used in draw
-    glUniform1i(glGetUniformLocation(shaderID, "colorTexture"), COLOR_TEXTURE);
-    glUniform1i(glGetUniformLocation(shaderID, "normalTexture"), NORMAL_TEXTURE);
-    glUniform1i(glGetUniformLocation(shaderID, "glossTexture"), GLOSS_TEXTURE);
-
-    // re-connect attribute arrays
-    glBindVertexArray(varrayIDs[TERRAIN_VARRAY]);
-
-    GLint positionAttrib = glGetAttribLocation(shaderID, "vPosition");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
-    glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(positionAttrib);
-
-    GLint tangentAttrib = glGetAttribLocation(shaderID, "vTangent");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
-    glVertexAttribPointer(tangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(tangentAttrib);
-
-    GLint bitangentAttrib = glGetAttribLocation(shaderID, "vBitangent");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
-    glVertexAttribPointer(bitangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(bitangentAttrib);
-
-    GLint normalAttrib = glGetAttribLocation(shaderID, "vNormal");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
-    glVertexAttribPointer(normalAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(normalAttrib);
-
-    GLint uvAttrib = glGetAttribLocation(shaderID, "vUV");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
-    glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(uvAttrib);
-
-    // turn off everything we enabled
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
+    glUniform1i(glGetUniformLocation(shaderID, "surfaceTexture"),
+                SURFACE_TEXTURE);
 }
 
 //
@@ -232,35 +665,31 @@ void Terrain::updateShaders()
 //
 void Terrain::draw() const
 {
-    // enable shaders
-    glUseProgram(shaderID);
+    CpuProfiler::Zone zone("Terrain::draw");
+
+    // enable shader variant for current features
+    GLState::useProgram(shaderIDs[features % NUM_VARIANTS]);
 
     // enable vertex array and textures
-    glBindVertexArray(varrayIDs[TERRAIN_VARRAY]);
-    for(int i=0; i<NUM_TEXTURES; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, textureIDs[i]);
-    }
+    GLState::bindVertexArray(varrayIDs[TERRAIN_VARRAY]);
+    for(int i=0; i<NUM_TEXTURES; ++i)
+        GLState::bindTexture(i, GL_TEXTURE_2D_ARRAY, textureIDs[i]);
 
     // draw the triangles for each three indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
     glDrawElements(GL_TRIANGLES, 3*numtri, GL_UNSIGNED_INT, 0);
-
-    // turn of whatever we turned on
-    for(int i=0; i<NUM_TEXTURES; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, 0);
-    }
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
+    Metrics::drawCalls.add();
+    Metrics::triangles.add(numtri);
 }
 
 //
 // update view if necessary based on a/d keys
 //
-void Terrain::getElevation(float x, float y, float &e, float &t_xz, float &t_yz)
+void Terrain::getElevation(float x, float y, float &e, float &t_xz, float &t_yz) const
 {
+    CpuProfiler::Zone zone("Terrain::getElevation");
+    Metrics::elevationQueries.add();
+
 	float u0, v0, w0, u1, v1, w1, uvw0, uvw1, theta_xz, theta_yz;
 	float elevation = 0.f;
 	Vec3f n;
@@ -5,8 +5,24 @@
 #include "Vec.hpp"
 #include "Shader.hpp"
 
+#include <string>
+
+class TaskGraph;
+class FrameScheduler;
+struct ImagePPM;
+
 // terrain data and rendering methods
 class Terrain {
+// public constants
+public:
+    // optional shading features, compiled into separate program variants
+    enum {FOG_FEATURE = 1,      // fade to white with distance
+          NORMALMAP_FEATURE = 2,// bumps from normal map
+          NUM_VARIANTS = 4};    // every combination of features
+
+    // source images for the surface textures
+    enum {COLOR_IMAGE, NORMAL_IMAGE, GLOSS_IMAGE, NUM_IMAGES};
+
 // private data
 private:
 	unsigned int repl;			// ammount of replication in both x and y directions
@@ -23,43 +39,124 @@ private:
     unsigned int numtri;        // total triangles
     Vec<unsigned int, 3> *indices; // 3 vertex indices per triangle
 
+    // when loaded from the mesh cache, the arrays above point into this
+    // mapping of the cache file rather than separate allocations
+    void *meshMap;              // cache file contents, or 0 if built here
+    unsigned long meshMapSize;  // size of cache mapping in bytes
+
     // GL vertex array object IDs
     enum {TERRAIN_VARRAY, NUM_VARRAYS};
     unsigned int varrayIDs[NUM_VARRAYS];
 
-    // GL texture IDs
-    enum {COLOR_TEXTURE, NORMAL_TEXTURE, GLOSS_TEXTURE, NUM_TEXTURES};
+    // GL texture IDs: one RGBA texture array holding every surface
+    // layer, so one texture unit, with one fetch per layer
+    enum {SURFACE_TEXTURE, NUM_TEXTURES};
     unsigned int textureIDs[NUM_TEXTURES];
 
+    // layers of the surface texture array, in shader layer order
+    //   COLOR_LAYER: rgb color, spare alpha
+    //   MATERIAL_LAYER: normal map x & y (z is rebuilt), gloss, spare
+    enum {COLOR_LAYER, MATERIAL_LAYER, NUM_LAYERS};
+
+    // source files: elevation kept until loaded, images for reloads
+    const char *elevationFile;  // elevation image
+    const char *meshCacheFile;  // mesh cache, or 0 to always build
+    std::string imageFiles[NUM_IMAGES]; // file for each source image
+    ImagePPM *images[NUM_IMAGES];       // decoded, waiting to be packed
+    Vec4c *layers;              // packed layers, waiting for upload
+    unsigned int layerWidth, layerHeight;   // size of every layer
+
     // GL buffer object IDs
     enum {POSITION_BUFFER, TANGENT_BUFFER, BITANGENT_BUFFER, NORMAL_BUFFER, 
           UV_BUFFER, INDEX_BUFFER, NUM_BUFFERS};
     unsigned int bufferIDs[NUM_BUFFERS];
 
-    // GL shaders
-    unsigned int shaderID;      // ID for shader program
-    ShaderInfo shaderParts[2];  // vertex & fragment shader info
+    // GL shaders: one program variant per combination of features
+    unsigned int shaderIDs[NUM_VARIANTS];   // ID for each shader program
+    ShaderInfo shaderParts[NUM_VARIANTS][2];// vertex & fragment shader info
+    ShaderBuild shaderBuilds[NUM_VARIANTS]; // replacement programs being built
+
+    // scheduled jobs not yet run, or stale handles (0 = none)
+    unsigned int textureJobs[NUM_IMAGES];   // source image replacement
+    unsigned int shaderJobs[NUM_VARIANTS];  // shader rebuild start
+
+// private methods
+private:
+    // connect uniforms and textures to new program for variant
+    void bindProgram(unsigned int variant);
+
+    // load or build mesh arrays (any thread)
+    void loadMesh();
+
+    // copy mesh arrays into GL buffers
+    void uploadMesh();
+
+    // pack decoded images into the layers array (any thread)
+    void packLayers(unsigned int firstLayer, unsigned int numLayers);
+
+    // copy packed layers into the texture array
+    void uploadLayers(unsigned int firstLayer, unsigned int numLayers);
+
+    // load source image from file and update its layer now
+    void replaceTexture(const char *ppm, unsigned int image);
+
+    // start and finish the first build of each shader variant
+    void startShaderBuilds();
+    void finishShaderBuilds();
+
+    // build mesh arrays from elevation image
+    void buildMesh(const ImagePPM &elevation);
+
+    // try to use mesh cache file matching key, return false if stale
+    bool loadMeshCache(const char *cacheFile, unsigned long long key);
+
+    // save current mesh arrays to cache file under key
+    void writeMeshCache(const char *cacheFile, unsigned long long key) const;
+
+// public data
+public:
+    double meshTime;            // seconds spent building or loading mesh
+    bool meshCached;            // true if mesh came from the cache file
+    unsigned int features;      // OR of *_FEATURE flags to draw with
+    FrameScheduler *scheduler;  // runs texture and shader updates between
+                                // frames, or 0 to run them immediately
 
 // public methods
 public:
-    // load terrain, given elevation image and surface texture
+    // create terrain, given elevation image and surface textures
+    // mesh is cached in meshCache, and only rebuilt when stale
+    // meshCache = 0 to always build
+    // elevation file name must stay valid until load's tasks have run
     Terrain(const char *elevationPPM, const char *texturePPM,
-            const char *normalPPM, const char *glossPPM);
+            const char *normalPPM, const char *glossPPM,
+            const char *meshCache);
+
+    // add tasks to load textures, mesh and shaders to graph
+    // returns a task that finishes once the terrain can be drawn
+    unsigned int load(TaskGraph &graph);
 
     // clean up allocated memory
     ~Terrain();
 
-    // load/reload a texture
-    void updateTexture(const char *ppm, unsigned int textureID);
+    // load/reload one of the *_IMAGE source images
+    void updateTexture(const char *ppm, unsigned int image);
 
-    // load/reload shaders
+    // start loading/reloading shaders in the background
     void updateShaders();
 
+    // switch to reloaded shaders once they are ready
+    // return true if any program changed
+    bool pollShaders();
+
     // draw this terrain object
     void draw() const;
 
+    // triangles drawn per frame
+    unsigned int triangles() const { return numtri; }
+
 	// determine elevation at point x, y
-	void getElevation(float x, float y, float &e, float &t_xz, float &t_yz);
+	// only reads the mesh, so safe to call from the simulation thread
+	void getElevation(float x, float y, float &e, float &t_xz, float &t_yz) const;
 };
 
 #endif
@@ -0,0 +1,66 @@
+// hand the latest value from one thread to another without locking
+#ifndef TripleBuffer_hpp
+#define TripleBuffer_hpp
+
+#include <atomic>
+
+// One writer and one reader share three slots. The writer owns one
+// (back), the reader owns one (front), and the third (middle) holds the
+// newest complete value. Publishing swaps back with middle; taking the
+// newest value swaps middle with front. Each swap is one atomic
+// exchange, so neither side ever waits for the other, and the reader
+// skips any values it was too slow to see. The middle index carries a
+// FRESH bit so the reader knows whether it has changed since the last
+// swap.
+template <typename T>
+class TripleBuffer {
+// private data
+private:
+    enum {FRESH = 4};           // middle slot holds an unread value
+
+    T slot[3];
+    std::atomic<unsigned int> middle;   // slot index, plus FRESH
+    unsigned int back;          // slot only the writer uses
+    unsigned int front;         // slot only the reader uses
+
+// public methods
+public:
+    // all slots start as copies of initial
+    explicit TripleBuffer(const T &initial = T())
+        : middle(1), back(0), front(2)
+    {
+        slot[0] = slot[1] = slot[2] = initial;
+    }
+
+    // writer: value to fill in before publish
+    T &write() { return slot[back]; }
+
+    // writer: make the written value the newest, and start the next
+    // write from a copy of it
+    void publish()
+    {
+        // release: slot contents are visible before the index is
+        // acquire: the slot we get back is no longer being read
+        unsigned int old = middle.exchange(back | FRESH,
+                                           std::memory_order_acq_rel);
+        T &written = slot[back];
+        back = old & ~FRESH;
+        slot[back] = written;
+    }
+
+    // reader: switch to the newest value if there is one since the
+    // last update. Returns true if it changed.
+    bool update()
+    {
+        if (! (middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        unsigned int old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & ~FRESH;
+        return true;
+    }
+
+    // reader: newest value as of the last update
+    const T &read() const { return slot[front]; }
+};
+
+#endif
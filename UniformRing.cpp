@@ -0,0 +1,142 @@
+// per-frame uniform data shared through one ring buffer
+
+#include "UniformRing.hpp"
+#include "MemoryTracker.hpp"
+#include "GLState.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <string.h>
+
+//
+// create buffer, mapping it if possible
+//
+UniformRing::UniformRing(unsigned int size)
+    : mapped(0), segment(0), used(0), overflowed(false),
+      persistent(false), waits(0)
+{
+    GLint align;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    alignment = align > 0 ? align : 256;
+
+    // every segment must start on a bindable offset
+    segmentSize = (size + alignment - 1) / alignment * alignment;
+    for(int i=0; i<NUM_SEGMENTS; ++i)
+        fences[i] = 0;
+
+    glGenBuffers(1, &bufferID);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+    if (GLEW_ARB_buffer_storage) {
+        // immutable storage, mapped for the life of the buffer
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+            | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, NUM_SEGMENTS*segmentSize, 0, flags);
+        mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0,
+                                         NUM_SEGMENTS*segmentSize, flags);
+        persistent = mapped != 0;
+    }
+    if (! persistent) {
+        // one segment, orphaned each frame
+        GLState::deleteBuffers(1, &bufferID);
+        glGenBuffers(1, &bufferID);
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize, 0, GL_STREAM_DRAW);
+    }
+    MemoryTracker::bufferData(MemoryTracker::UNIFORMS, bufferID,
+                              persistent ? NUM_SEGMENTS*segmentSize
+                                         : segmentSize);
+}
+
+//
+// delete fences and buffer (deleting the buffer also unmaps it)
+// and report stalls
+//
+UniformRing::~UniformRing()
+{
+    for(int i=0; i<NUM_SEGMENTS; ++i)
+        if (fences[i]) glDeleteSync(fences[i]);
+    GLState::deleteBuffers(1, &bufferID);
+    MemoryTracker::deleteBuffers(1, &bufferID);
+
+    if (persistent)
+        fprintf(stderr, "uniform ring: %u frames waited for the GPU\n",
+                waits);
+}
+
+//
+// get the next segment ready for writing
+//
+void UniformRing::beginFrame()
+{
+    used = 0;
+
+    if (persistent) {
+        // wait for GPU to finish the frame that last used this segment
+        GLsync fence = fences[segment];
+        if (! fence) return;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            ++waits;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    GLuint64(1000000000)) == GL_TIMEOUT_EXPIRED)
+                ;
+        }
+        glDeleteSync(fence);
+        fences[segment] = 0;
+    }
+    else {
+        // orphan: GPU keeps the old storage until it is done with it
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize, 0, GL_STREAM_DRAW);
+    }
+}
+
+//
+// allocate, fill, and bind one uniform block
+//
+bool UniformRing::bind(unsigned int binding, const void *data,
+                       unsigned int size)
+{
+    if (used + size > segmentSize) {
+        if (! overflowed)
+            fprintf(stderr, "uniform ring: %u byte segment is too small\n",
+                    segmentSize);
+        overflowed = true;
+        return false;
+    }
+
+    unsigned int offset = used;
+    used = (used + size + alignment - 1) / alignment * alignment;
+
+    if (persistent) {
+        offset += segment * segmentSize;
+        memcpy(mapped + offset, data, size);
+    }
+    else {
+        // nothing earlier this frame uses this range of the new storage
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, bufferID);
+        void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+                                     GL_MAP_WRITE_BIT
+                                     | GL_MAP_INVALIDATE_RANGE_BIT
+                                     | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (ptr) {
+            memcpy(ptr, data, size);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+    }
+
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, bufferID, offset, size);
+    return true;
+}
+
+//
+// mark end of GPU use of this segment and move to the next
+//
+void UniformRing::endFrame()
+{
+    if (! persistent) return;
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    segment = (segment + 1) % NUM_SEGMENTS;
+}
@@ -0,0 +1,54 @@
+// per-frame uniform data shared through one ring buffer
+#ifndef UniformRing_hpp
+#define UniformRing_hpp
+
+struct __GLsync;
+
+// One large uniform buffer split into a segment per frame in flight.
+// Each frame's uniform blocks are copied into the current segment and
+// bound with glBindBufferRange, so objects don't need buffers of their
+// own, and the GPU is never still reading the memory being written.
+//
+// With ARB_buffer_storage, the buffer is mapped once and written
+// directly. A fence at the end of each frame says when the GPU is done
+// with that segment, so the CPU only waits if it gets NUM_SEGMENTS
+// frames ahead. Without it, the buffer is orphaned every frame and
+// written with unsynchronized maps of the fresh storage.
+class UniformRing {
+// private data
+private:
+    enum {NUM_SEGMENTS = 3};    // frames in flight
+    unsigned int bufferID;      // GL buffer holding all segments
+    unsigned int segmentSize;   // bytes per frame
+    unsigned int alignment;     // required offset alignment for binding
+    char *mapped;               // persistent mapping of buffer, or 0
+    __GLsync *fences[NUM_SEGMENTS]; // GPU done with segment, or 0
+    unsigned int segment;       // segment for current frame
+    unsigned int used;          // bytes allocated in current segment
+    bool overflowed;            // already reported running out of space
+
+// public data
+public:
+    bool persistent;            // using persistent mapping
+    unsigned int waits;         // frames that had to wait for the GPU
+
+// public methods
+public:
+    // create ring with space for segmentSize bytes of blocks per frame
+    UniformRing(unsigned int segmentSize);
+
+    // release buffer
+    ~UniformRing();
+
+    // start filling the next segment, call before any bind
+    void beginFrame();
+
+    // copy size bytes of data into the ring and bind it to uniform
+    // block binding point. Return false if the frame is out of space
+    bool bind(unsigned int binding, const void *data, unsigned int size);
+
+    // done with current segment, call after the frame's last draw
+    void endFrame();
+};
+
+#endif
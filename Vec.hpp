@@ -16,7 +16,8 @@ struct Vec {
 
     // array-like access must be public member functions
     // all other operations as template functions in Vec.inl
-    T operator[](int i) const { return data[i]; }
+    // read access is constexpr for compile-time constants
+    constexpr T operator[](int i) const { return data[i]; }
     T &operator[](int i) { return data[i]; }
 };
 
@@ -30,7 +31,7 @@ struct Vec<T,2> {
         T data[2];
         struct { T x, y; };
     };
-    T operator[](int i) const { return data[i]; }
+    constexpr T operator[](int i) const { return data[i]; }
     T &operator[](int i) { return data[i]; }
 };
 
@@ -44,7 +45,7 @@ struct Vec<T,3> {
         struct { T r, g, b; };
         Vec<T,2> xy;
     };
-    T operator[](int i) const { return data[i]; }
+    constexpr T operator[](int i) const { return data[i]; }
     T &operator[](int i) { return data[i]; }
 };
 
@@ -60,7 +61,7 @@ struct Vec<T,4> {
         Vec<T,3> xyz;
         Vec<T,3> rgb;
     };
-    T operator[](int i) const { return data[i]; }
+    constexpr T operator[](int i) const { return data[i]; }
     T &operator[](int i) { return data[i]; }
 };
 
@@ -24,6 +24,10 @@ inline int dimensions(const Vec<T,N> &v) {
 // guarantees the type will be exactly equivalent to an array in
 // memory.
 
+// Builders from components are constexpr, so constant vectors can be
+// built at compile time. Inside constexpr functions, components must
+// be read as v.data[i], not v.x, since only data is initialized
+
 // all components equal to single scalar value
 template <typename T, int N>
 Vec<T,N> vec(T s) {
@@ -35,28 +39,16 @@ Vec<T,N> vec(T s) {
 
 // build 2D, 3D or 4D from a list of components
 template <typename T>
-inline Vec<T,2> vec2(T x, T y) {
-    Vec<T,2> result;
-    result[0] = x;
-    result[1] = y;
-    return result;
+constexpr Vec<T,2> vec2(T x, T y) {
+    return Vec<T,2>{{{x, y}}};
 }
 template <typename T>
-inline Vec<T,3> vec3(T x, T y, T z) {
-    Vec<T,3> result;
-    result[0] = x;
-    result[1] = y;
-    result[2] = z;
-    return result;
+constexpr Vec<T,3> vec3(T x, T y, T z) {
+    return Vec<T,3>{{{x, y, z}}};
 }
 template <typename T>
-inline Vec<T,4> vec4(T x, T y, T z, T w) {
-    Vec<T,4> result;
-    result[0] = x;
-    result[1] = y;
-    result[2] = z;
-    result[3] = w;
-    return result;
+constexpr Vec<T,4> vec4(T x, T y, T z, T w) {
+    return Vec<T,4>{{{x, y, z, w}}};
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,231 @@
+// structure-of-arrays storage for many 3D float vectors
+
+#include "Vec3fArray.hpp"
+#include "Mat.inl"
+#include "Vec.inl"
+#include <math.h>
+#include <string.h>
+
+// Each kernel is written once over a "lane" of LANES floats from each
+// stream: 8 with AVX, 4 with SSE, or a single float otherwise.
+namespace {
+#if defined(MAT_SSE) && defined(__AVX__)
+    typedef __m256 Lane;
+    const unsigned int LANES = 8;
+    inline Lane load(const float *p) { return _mm256_loadu_ps(p); }
+    inline void store(float *p, Lane a) { _mm256_storeu_ps(p, a); }
+    inline Lane splat(float s) { return _mm256_set1_ps(s); }
+    inline Lane plus(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+    inline Lane minus(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+    inline Lane times(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+    inline Lane over(Lane a, Lane b) { return _mm256_div_ps(a, b); }
+    inline Lane root(Lane a) { return _mm256_sqrt_ps(a); }
+#elif defined(MAT_SSE)
+    typedef __m128 Lane;
+    const unsigned int LANES = 4;
+    inline Lane load(const float *p) { return _mm_loadu_ps(p); }
+    inline void store(float *p, Lane a) { _mm_storeu_ps(p, a); }
+    inline Lane splat(float s) { return _mm_set1_ps(s); }
+    inline Lane plus(Lane a, Lane b) { return _mm_add_ps(a, b); }
+    inline Lane minus(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+    inline Lane times(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+    inline Lane over(Lane a, Lane b) { return _mm_div_ps(a, b); }
+    inline Lane root(Lane a) { return _mm_sqrt_ps(a); }
+#else
+    typedef float Lane;
+    const unsigned int LANES = 1;
+    inline Lane load(const float *p) { return *p; }
+    inline void store(float *p, Lane a) { *p = a; }
+    inline Lane splat(float s) { return s; }
+    inline Lane plus(Lane a, Lane b) { return a + b; }
+    inline Lane minus(Lane a, Lane b) { return a - b; }
+    inline Lane times(Lane a, Lane b) { return a * b; }
+    inline Lane over(Lane a, Lane b) { return a / b; }
+    inline Lane root(Lane a) { return sqrtf(a); }
+#endif
+
+    // streams are padded to a multiple of this
+    const unsigned int PADDING = 8;
+
+    // a*x + b*y + c*z + d for one lane
+    inline Lane combine(Lane x, Lane y, Lane z,
+                        float a, float b, float c, float d) {
+        return plus(plus(times(splat(a), x), times(splat(b), y)),
+                    plus(times(splat(c), z), splat(d)));
+    }
+
+    // shared body of the affine transforms
+    // m is column-major, w is 1 for points or 0 for directions
+    void transform(const float m[4][4], float w,
+                   const Vec3fArray &a, Vec3fArray &result) {
+        result.resize(a.size);
+        for(unsigned int i=0; i<a.size; i+=LANES) {
+            Lane x = load(a.x+i), y = load(a.y+i), z = load(a.z+i);
+            store(result.x+i, combine(x, y, z, m[0][0], m[1][0], m[2][0],
+                                      w*m[3][0]));
+            store(result.y+i, combine(x, y, z, m[0][1], m[1][1], m[2][1],
+                                      w*m[3][1]));
+            store(result.z+i, combine(x, y, z, m[0][2], m[1][2], m[2][2],
+                                      w*m[3][2]));
+        }
+    }
+}
+
+//
+// allocate zeroed streams
+//
+Vec3fArray::Vec3fArray(unsigned int n)
+    : size(0), capacity(0), x(0), y(0), z(0)
+{
+    resize(n);
+}
+
+Vec3fArray::~Vec3fArray()
+{
+    delete[] x;
+    delete[] y;
+    delete[] z;
+}
+
+//
+// grow streams if needed
+//
+void Vec3fArray::resize(unsigned int n)
+{
+    if (n > capacity) {
+        unsigned int newCapacity = (n + PADDING - 1) / PADDING * PADDING;
+        float **streams[3] = {&x, &y, &z};
+        for(int c=0; c<3; ++c) {
+            float *stream = new float[newCapacity];
+            if (size) memcpy(stream, *streams[c], size*sizeof(float));
+            memset(stream + size, 0, (newCapacity - size)*sizeof(float));
+            delete[] *streams[c];
+            *streams[c] = stream;
+        }
+        capacity = newCapacity;
+    }
+    size = n;
+}
+
+//
+// single vector access
+//
+Vec3f Vec3fArray::operator()(unsigned int i) const
+{
+    return vec3<float>(x[i], y[i], z[i]);
+}
+
+void Vec3fArray::set(unsigned int i, const Vec3f &v)
+{
+    x[i] = v.x;
+    y[i] = v.y;
+    z[i] = v.z;
+}
+
+//
+// conversion from and to array-of-structs
+//
+void Vec3fArray::load(const Vec3f *v, unsigned int n)
+{
+    resize(n);
+    for(unsigned int i=0; i<n; ++i) {
+        x[i] = v[i].x;
+        y[i] = v[i].y;
+        z[i] = v[i].z;
+    }
+}
+
+void Vec3fArray::store(Vec3f *v) const
+{
+    for(unsigned int i=0; i<size; ++i)
+        v[i] = vec3<float>(x[i], y[i], z[i]);
+}
+
+//
+// element-wise arithmetic
+//
+void add(const Vec3fArray &a, const Vec3fArray &b, Vec3fArray &result)
+{
+    result.resize(a.size);
+    for(unsigned int i=0; i<a.size; i+=LANES) {
+        store(result.x+i, plus(load(a.x+i), load(b.x+i)));
+        store(result.y+i, plus(load(a.y+i), load(b.y+i)));
+        store(result.z+i, plus(load(a.z+i), load(b.z+i)));
+    }
+}
+
+void scale(const Vec3fArray &a, float s, Vec3fArray &result)
+{
+    result.resize(a.size);
+    Lane ls = splat(s);
+    for(unsigned int i=0; i<a.size; i+=LANES) {
+        store(result.x+i, times(load(a.x+i), ls));
+        store(result.y+i, times(load(a.y+i), ls));
+        store(result.z+i, times(load(a.z+i), ls));
+    }
+}
+
+void cross(const Vec3fArray &a, const Vec3fArray &b, Vec3fArray &result)
+{
+    result.resize(a.size);
+    for(unsigned int i=0; i<a.size; i+=LANES) {
+        Lane ax = load(a.x+i), ay = load(a.y+i), az = load(a.z+i);
+        Lane bx = load(b.x+i), by = load(b.y+i), bz = load(b.z+i);
+        store(result.x+i, minus(times(ay, bz), times(az, by)));
+        store(result.y+i, minus(times(az, bx), times(ax, bz)));
+        store(result.z+i, minus(times(ax, by), times(ay, bx)));
+    }
+}
+
+// matches normalize(Vec3f): divide by the length, not a reciprocal
+// estimate, so results are the same as one at a time
+void normalize(const Vec3fArray &a, Vec3fArray &result)
+{
+    result.resize(a.size);
+    for(unsigned int i=0; i<a.size; i+=LANES) {
+        Lane x = load(a.x+i), y = load(a.y+i), z = load(a.z+i);
+        Lane len = root(plus(plus(times(x, x), times(y, y)), times(z, z)));
+        store(result.x+i, over(x, len));
+        store(result.y+i, over(y, len));
+        store(result.z+i, over(z, len));
+    }
+}
+
+// result only has a.size entries, so the last partial lane is scalar
+void dot(const Vec3fArray &a, const Vec3fArray &b, float *result)
+{
+    unsigned int i = 0;
+    for(; i+LANES <= a.size; i+=LANES)
+        store(result+i, plus(plus(times(load(a.x+i), load(b.x+i)),
+                                  times(load(a.y+i), load(b.y+i))),
+                             times(load(a.z+i), load(b.z+i))));
+    for(; i<a.size; ++i)
+        result[i] = a.x[i]*b.x[i] + a.y[i]*b.y[i] + a.z[i]*b.z[i];
+}
+
+//
+// transforms
+//
+void transformPoints(const Mat4f &m, const Vec3fArray &a, Vec3fArray &result)
+{
+    transform(m.data, 1, a, result);
+}
+
+void transformVectors(const Mat4f &m, const Vec3fArray &a,
+                      Vec3fArray &result)
+{
+    transform(m.data, 0, a, result);
+}
+
+void transformPoints(const MatPair4f &m, const Vec3fArray &a,
+                     Vec3fArray &result)
+{
+    transform(m.matrix.data, 1, a, result);
+}
+
+// n * inverse is transpose(inverse) * n
+void transformNormals(const MatPair4f &m, const Vec3fArray &a,
+                      Vec3fArray &result)
+{
+    transform(transpose(m.inverse).data, 0, a, result);
+}
@@ -0,0 +1,67 @@
+// structure-of-arrays storage for many 3D float vectors
+#ifndef Vec3fArray_hpp
+#define Vec3fArray_hpp
+
+#include "Vec.hpp"
+#include "MatPair.hpp"
+
+// x, y and z of every vector are kept in separate streams, so the bulk
+// operations below can work on several vectors at once with SIMD.
+// Streams are padded to a multiple of 8 so kernels never need a
+// scalar cleanup loop. The padding holds garbage after most kernels.
+struct Vec3fArray {
+    unsigned int size;          // number of vectors
+    unsigned int capacity;      // allocated length of each stream
+    float *x, *y, *z;           // component streams
+
+// public methods
+public:
+    // create with space for size vectors
+    Vec3fArray(unsigned int size = 0);
+
+    // destroy when done
+    ~Vec3fArray();
+
+    // change number of vectors, keeping existing contents
+    void resize(unsigned int size);
+
+    // access one vector as array(i)
+    Vec3f operator()(unsigned int i) const;
+    void set(unsigned int i, const Vec3f &v);
+
+    // copy from n array-of-structs vectors, resizing to n
+    void load(const Vec3f *v, unsigned int n);
+
+    // copy all vectors out to array-of-structs v[size]
+    void store(Vec3f *v) const;
+
+// not copyable: would share streams
+private:
+    Vec3fArray(const Vec3fArray &);
+    Vec3fArray &operator=(const Vec3fArray &);
+};
+
+// bulk operations on each vector in turn. Results are resized to the
+// input size, and may be the same array as either input
+void add(const Vec3fArray &a, const Vec3fArray &b, Vec3fArray &result);
+void scale(const Vec3fArray &a, float s, Vec3fArray &result);
+void cross(const Vec3fArray &a, const Vec3fArray &b, Vec3fArray &result);
+void normalize(const Vec3fArray &a, Vec3fArray &result);
+
+// result[a.size] = dot product of each pair of vectors
+void dot(const Vec3fArray &a, const Vec3fArray &b, float *result);
+
+// transform as points (w=1) or directions (w=0) by an affine matrix
+void transformPoints(const Mat4f &m, const Vec3fArray &a,
+                     Vec3fArray &result);
+void transformVectors(const Mat4f &m, const Vec3fArray &a,
+                      Vec3fArray &result);
+
+// transform by a matrix pair: points by m.matrix, normals by the
+// inverse transpose, as the shaders do
+void transformPoints(const MatPair4f &m, const Vec3fArray &a,
+                     Vec3fArray &result);
+void transformNormals(const MatPair4f &m, const Vec3fArray &a,
+                      Vec3fArray &result);
+
+#endif
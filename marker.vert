@@ -2,13 +2,7 @@
 #version 400 core
 
 // per-frame data
-layout(std140)                  // use standard layout
-uniform SceneData {             // uniform struct name
-    mat4 viewMatrix, viewInverse;
-    mat4 projectionMatrix, projectionInverse;
-    vec3 lightpos;
-    int fog;
-};
+#include "SceneData.glsl"
 
 // model data
 layout(std140)                  // use standard layout
@@ -1,23 +1,24 @@
 // fragment shader for simple terrain application
+// compiled with optional #defines:
+//   NORMAL_MAP: bumps from normal map
+//   FOG: fade to white with distance
 #version 400 core
 
 // per-frame data
-layout(std140)                  // use standard layout
-uniform SceneData {             // uniform struct name
-    mat4 viewMatrix, viewInverse;
-    mat4 projectionMatrix, projectionInverse;
-    vec3 lightpos;
-    int fog;
-};
-
-// shader data
-uniform sampler2D colorTexture;
-uniform sampler2D normalTexture;
-uniform sampler2D glossTexture;
+#include "SceneData.glsl"
+
+// shader data: surface layers, in Terrain's order
+//   color: rgb color, spare alpha
+//   material: normal map x & y, gloss, spare
+uniform sampler2DArray surfaceTexture;
+const float COLOR_LAYER = 0, MATERIAL_LAYER = 1;
 
 // input from vertex shader
 in vec4 position, light;
-in vec3 tangent, bitangent, normal;
+#ifdef NORMAL_MAP
+in vec3 tangent, bitangent;
+#endif
+in vec3 normal;
 in vec2 texcoord;
 
 // output to frame buffer
@@ -30,11 +31,20 @@ void main() {
     vec3 lpos = light.xyz / light.w;
     vec3 terrainOrigin = viewMatrix[3].xyz / viewMatrix[3].w;
 
+    // normal map and gloss share one fetch
+    vec4 material = texture(surfaceTexture, vec3(texcoord, MATERIAL_LAYER));
+
     // surface normal, including extra bumps from normal map
-    vec3 nmap = texture(normalTexture, texcoord).xyz * 2 - 1;
+    // normal map z is always positive, so rebuild it from x & y
+#ifdef NORMAL_MAP
+    vec2 nxy = material.xy * 2 - 1;
+    vec3 nmap = vec3(nxy, sqrt(max(0., 1 - dot(nxy, nxy))));
     vec3 N = normalize(nmap.x * normalize(tangent) +
                        nmap.y * normalize(bitangent) + 
                        nmap.z * normalize(normal));
+#else
+    vec3 N = normalize(normal);
+#endif
 
     // light vectors and dot products
     // for point light, use normalize(lpos - pos)
@@ -46,17 +56,18 @@ void main() {
     
     // specular: normalized Blinn-Phong with Kelemen/Szirmay Kalos shadow/mask
     // Schlick approximation to Fresnel for index of refraction 1.5
-    float gloss = pow(8192, texture(glossTexture, texcoord).x);
+    float gloss = pow(8192, material.z);
     float spec = (gloss+2) * pow(N_H, gloss) / (1 + max(0.,V_L));
     float fresnel = 0.04 + 0.96 * pow(1 - V_H, 5);
 
     // combined specular and diffuse
-    vec3 color = texture(colorTexture, texcoord).rgb;
+    vec3 color = texture(surfaceTexture, vec3(texcoord, COLOR_LAYER)).rgb;
     color = mix(color, vec3(spec), fresnel) * N_L;
 
     // fade to white with fog
-    if (fog != 0)
-        color = mix(vec3(1,1,1), color, exp2(.005 * pos.z));
+#ifdef FOG
+    color = mix(vec3(1,1,1), color, exp2(.005 * pos.z));
+#endif
 
     // final color
     fragColor = vec4(color, 1);
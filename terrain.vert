@@ -1,23 +1,24 @@
 // vertex shader for simple terrain demo
+// compiled with optional #defines:
+//   NORMAL_MAP: pass tangents for normal mapping
 #version 400 core
 
 // per-frame data
-layout(std140)                  // use standard layout
-uniform SceneData {             // uniform struct name
-    mat4 viewMatrix, viewInverse;
-    mat4 projectionMatrix, projectionInverse;
-    vec3 lightpos;
-    int fog;
-};
+#include "SceneData.glsl"
 
-// per-vertex input
-in vec3 vPosition;
-in vec3 vTangent, vBitangent, vNormal;
-in vec2 vUV;
+// per-vertex input, locations match Terrain buffer order
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vTangent;
+layout(location = 2) in vec3 vBitangent;
+layout(location = 3) in vec3 vNormal;
+layout(location = 4) in vec2 vUV;
 
 // output to fragment shader
 out vec4 position, light;
-out vec3 tangent, bitangent, normal;
+#ifdef NORMAL_MAP
+out vec3 tangent, bitangent;
+#endif
+out vec3 normal;
 out vec2 texcoord;
 
 void main() {
@@ -26,8 +27,10 @@ void main() {
     light = viewMatrix * vec4(lightpos, 1);
 
     // transform tangents and normal
+#ifdef NORMAL_MAP
     tangent = normalize(mat3(viewMatrix) * vTangent);
     bitangent = normalize(mat3(viewMatrix) * vBitangent);
+#endif
     normal = normalize(vNormal * mat3(viewInverse));
 
     // pass through texture coordinate